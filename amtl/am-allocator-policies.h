@@ -30,8 +30,16 @@
 #ifndef _include_amtl_allocatorpolicies_h_
 #define _include_amtl_allocatorpolicies_h_
 
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
 
 namespace ke {
 
@@ -66,6 +74,533 @@ class SystemAllocatorPolicy
             reportOutOfMemory();
         return ptr;
     }
+    void* am_realloc(void* memory, size_t oldBytes, size_t newBytes) {
+#if defined(_DEBUG) && defined(_CRTDBG_MAP_ALLOC)
+        void* ptr = realloc(memory, newBytes);
+#else
+        void* ptr = ::realloc(memory, newBytes);
+#endif
+        if (!ptr)
+            reportOutOfMemory();
+        return ptr;
+    }
+};
+
+// Whether an array of T can be moved to new memory with memcpy, leaving the
+// old copy to be freed without running destructors. This holds for most
+// types that do not point into themselves; specialize it for those that
+// are not trivially copyable but qualify anyway.
+template <typename T>
+struct IsTriviallyRelocatable : std::is_trivially_copyable<T>
+{};
+
+namespace detail {
+
+template <typename T>
+struct AllocPolicyVoid {
+    typedef void type;
+};
+
+template <typename AllocPolicy, typename = void>
+struct HasAlignedMalloc : std::false_type {};
+
+template <typename AllocPolicy>
+struct HasAlignedMalloc<AllocPolicy, typename AllocPolicyVoid<decltype(
+    std::declval<AllocPolicy&>().am_malloc_aligned(size_t(), size_t()))>::type>
+  : std::true_type
+{};
+
+template <typename AllocPolicy, typename = void>
+struct HasSizedFree : std::false_type {};
+
+template <typename AllocPolicy>
+struct HasSizedFree<AllocPolicy, typename AllocPolicyVoid<decltype(
+    std::declval<AllocPolicy&>().am_free(std::declval<void*>(), size_t()))>::type>
+  : std::true_type
+{};
+
+// The class declaring a non-static member function. There is no |type| for
+// anything else, such as a static function.
+template <typename T>
+struct AllocPolicyMemberOf {};
+
+template <typename C, typename R, typename... Args>
+struct AllocPolicyMemberOf<R (C::*)(Args...)> {
+    typedef C type;
+};
+template <typename C, typename R, typename... Args>
+struct AllocPolicyMemberOf<R (C::*)(Args...) const> {
+    typedef C type;
+};
+#if defined(__cpp_noexcept_function_type)
+template <typename C, typename R, typename... Args>
+struct AllocPolicyMemberOf<R (C::*)(Args...) noexcept> {
+    typedef C type;
+};
+template <typename C, typename R, typename... Args>
+struct AllocPolicyMemberOf<R (C::*)(Args...) const noexcept> {
+    typedef C type;
+};
+#endif
+
+// Whether am_realloc() and am_malloc() are declared by the same class. If
+// either is overloaded or static, this cannot be told, and is false.
+template <typename AllocPolicy, typename = void>
+struct ReallocMatchesMalloc : std::false_type {};
+
+template <typename AllocPolicy>
+struct ReallocMatchesMalloc<AllocPolicy, typename AllocPolicyVoid<std::is_same<
+    typename AllocPolicyMemberOf<decltype(&AllocPolicy::am_realloc)>::type,
+    typename AllocPolicyMemberOf<decltype(&AllocPolicy::am_malloc)>::type>>::type>
+  : std::is_same<typename AllocPolicyMemberOf<decltype(&AllocPolicy::am_realloc)>::type,
+                 typename AllocPolicyMemberOf<decltype(&AllocPolicy::am_malloc)>::type>
+{};
+
+// am_realloc() is only used if it comes from the same class as am_malloc(),
+// so that a policy replacing am_malloc() does not inherit a realloc that
+// bypasses it.
+template <typename AllocPolicy, typename = void>
+struct HasRealloc : std::false_type {};
+
+template <typename AllocPolicy>
+struct HasRealloc<AllocPolicy, typename AllocPolicyVoid<decltype(
+    std::declval<AllocPolicy&>().am_realloc(std::declval<void*>(), size_t(), size_t()))>::type>
+  : ReallocMatchesMalloc<AllocPolicy>
+{};
+
+} // namespace detail
+
+// Besides am_malloc(bytes) and am_free(ptr), an allocator policy may provide
+//
+//   void* am_malloc_aligned(size_t bytes, size_t alignment);
+//   void am_free(void* ptr, size_t bytes);
+//   void* am_realloc(void* ptr, size_t oldBytes, size_t newBytes);
+//
+// to allocate with more than the usual alignment, to free memory without
+// having to look up its size, and to resize memory from am_malloc(),
+// possibly in place. Containers allocate through AllocPolicyTraits, which
+// uses these when a policy has them and falls back otherwise. A policy with
+// the sized am_free() may leave out the unsized one, if it is only used by
+// such containers.
+//
+// am_malloc() must return memory aligned for any standard type. Without
+// am_malloc_aligned(), a larger alignment is met by allocating extra space
+// and storing the original pointer just before the aligned one.
+template <typename AllocPolicy>
+struct AllocPolicyTraits
+{
+    static const bool kHasAlignedMalloc = detail::HasAlignedMalloc<AllocPolicy>::value;
+    static const bool kHasSizedFree = detail::HasSizedFree<AllocPolicy>::value;
+    static const bool kHasRealloc = detail::HasRealloc<AllocPolicy>::value;
+    static const size_t kDefaultAlignment = alignof(std::max_align_t);
+
+    // Returns null if out of memory. |alignment| must be a power of two.
+    static void* allocate(AllocPolicy* ap, size_t bytes,
+                          size_t alignment = kDefaultAlignment)
+    {
+        assert(alignment && !(alignment & (alignment - 1)));
+        if (alignment <= kDefaultAlignment)
+            return ap->am_malloc(bytes);
+        return allocateAligned(ap, bytes, alignment,
+                               std::integral_constant<bool, kHasAlignedMalloc>());
+    }
+
+    // Free memory from allocate(), which must be given the same size and
+    // alignment.
+    static void release(AllocPolicy* ap, void* ptr, size_t bytes,
+                        size_t alignment = kDefaultAlignment)
+    {
+        if (!ptr)
+            return;
+        if (alignment > kDefaultAlignment && !kHasAlignedMalloc) {
+            void* base = reinterpret_cast<void**>(ptr)[-1];
+            deallocate(ap, base, bytes + alignment - 1 + sizeof(void*),
+                       std::integral_constant<bool, kHasSizedFree>());
+            return;
+        }
+        deallocate(ap, ptr, bytes, std::integral_constant<bool, kHasSizedFree>());
+    }
+
+    // Resize memory from allocate(), keeping the first min(oldBytes,
+    // newBytes) bytes, as if by memcpy. Returns null if out of memory, in
+    // which case |ptr| is untouched.
+    static void* reallocate(AllocPolicy* ap, void* ptr, size_t oldBytes, size_t newBytes,
+                            size_t alignment = kDefaultAlignment)
+    {
+        if (ptr && alignment <= kDefaultAlignment)
+            return reallocate(ap, ptr, oldBytes, newBytes,
+                              std::integral_constant<bool, kHasRealloc>());
+
+        void* result = allocate(ap, newBytes, alignment);
+        if (!result)
+            return nullptr;
+        if (ptr) {
+            memcpy(result, ptr, oldBytes < newBytes ? oldBytes : newBytes);
+            release(ap, ptr, oldBytes, alignment);
+        }
+        return result;
+    }
+
+  private:
+    static void* reallocate(AllocPolicy* ap, void* ptr, size_t oldBytes, size_t newBytes,
+                            std::true_type)
+    {
+        return ap->am_realloc(ptr, oldBytes, newBytes);
+    }
+    static void* reallocate(AllocPolicy* ap, void* ptr, size_t oldBytes, size_t newBytes,
+                            std::false_type)
+    {
+        void* result = ap->am_malloc(newBytes);
+        if (!result)
+            return nullptr;
+        memcpy(result, ptr, oldBytes < newBytes ? oldBytes : newBytes);
+        deallocate(ap, ptr, oldBytes, std::integral_constant<bool, kHasSizedFree>());
+        return result;
+    }
+
+    static void* allocateAligned(AllocPolicy* ap, size_t bytes, size_t alignment,
+                                 std::true_type)
+    {
+        return ap->am_malloc_aligned(bytes, alignment);
+    }
+    static void* allocateAligned(AllocPolicy* ap, size_t bytes, size_t alignment,
+                                 std::false_type)
+    {
+        size_t extra = alignment - 1 + sizeof(void*);
+        if (bytes > SIZE_MAX - extra) {
+            ap->reportAllocationOverflow();
+            return nullptr;
+        }
+        void* base = ap->am_malloc(bytes + extra);
+        if (!base)
+            return nullptr;
+
+        uintptr_t start = reinterpret_cast<uintptr_t>(base) + sizeof(void*);
+        void** ptr = reinterpret_cast<void**>((start + alignment - 1) & ~uintptr_t(alignment - 1));
+        ptr[-1] = base;
+        return ptr;
+    }
+
+    static void deallocate(AllocPolicy* ap, void* ptr, size_t bytes, std::true_type) {
+        ap->am_free(ptr, bytes);
+    }
+    static void deallocate(AllocPolicy* ap, void* ptr, size_t bytes, std::false_type) {
+        ap->am_free(ptr);
+    }
+};
+
+// A region of memory for many short-lived allocations, which are all freed
+// at once. Memory is carved from large chunks by bumping a pointer, so an
+// allocation is a compare and an add; individual allocations are never
+// freed.
+//
+// Chunks come from AllocPolicy. reset() makes every allocation invalid but
+// keeps the chunks to reuse, which suits per-frame or per-request scratch
+// memory. release() returns all chunks to AllocPolicy.
+template <typename AllocPolicy = SystemAllocatorPolicy>
+class Arena : private AllocPolicy
+{
+    // Chunks are linked through a header at their start.
+    struct Chunk {
+        Chunk* next;
+        size_t bytes;
+    };
+
+  public:
+    // The alignment of memory returned by allocate() when none is given,
+    // suitable for any type (as with malloc).
+    static const size_t kDefaultAlignment = alignof(std::max_align_t);
+    static const size_t kDefaultChunkSize = 64 * 1024;
+
+  private:
+    static const size_t kChunkHeader =
+        (sizeof(Chunk) + kDefaultAlignment - 1) & ~(kDefaultAlignment - 1);
+
+  public:
+    explicit Arena(size_t chunkSize = kDefaultChunkSize, AllocPolicy ap = AllocPolicy())
+     : AllocPolicy(ap),
+       chunkSize_(chunkSize),
+       chunks_(nullptr),
+       spare_(nullptr),
+       large_(nullptr),
+       cursor_(0),
+       limit_(0),
+       bytes_(0)
+    {
+        assert(chunkSize_ > kChunkHeader);
+    }
+
+    ~Arena() {
+        release();
+    }
+
+    // Returns null if out of memory. |alignment| must be a power of two.
+    void* allocate(size_t bytes, size_t alignment = kDefaultAlignment) {
+        assert(alignment && !(alignment & (alignment - 1)));
+
+        // Large requests get a chunk of their own, so that they don't waste
+        // the rest of the current chunk.
+        size_t usable = chunkSize_ - kChunkHeader;
+        if (bytes > usable / 4 || alignment > usable / 4) {
+            if (bytes > SIZE_MAX - kChunkHeader - alignment) {
+                this->reportAllocationOverflow();
+                return nullptr;
+            }
+            Chunk* chunk = newChunk(kChunkHeader + bytes + alignment - 1);
+            if (!chunk)
+                return nullptr;
+            chunk->next = large_;
+            large_ = chunk;
+            return reinterpret_cast<void*>(alignUp(start(chunk), alignment));
+        }
+
+        uintptr_t result = alignUp(cursor_, alignment);
+        if (!cursor_ || result > limit_ || limit_ - result < bytes) {
+            if (!nextChunk())
+                return nullptr;
+            result = alignUp(cursor_, alignment);
+        }
+        cursor_ = result + bytes;
+        return reinterpret_cast<void*>(result);
+    }
+
+    // Resize an allocation with the default alignment, keeping its
+    // contents. The most recent allocation grows or shrinks in place if its
+    // chunk has room; anything else is copied. Returns null if out of
+    // memory, leaving |ptr| intact.
+    void* reallocate(void* ptr, size_t oldBytes, size_t newBytes) {
+        uintptr_t start = reinterpret_cast<uintptr_t>(ptr);
+        if (ptr && start + oldBytes == cursor_ && newBytes <= limit_ - start) {
+            cursor_ = start + newBytes;
+            return ptr;
+        }
+
+        void* result = allocate(newBytes);
+        if (result && ptr)
+            memcpy(result, ptr, oldBytes < newBytes ? oldBytes : newBytes);
+        return result;
+    }
+
+    // Invalidate every allocation, keeping chunks of the standard size to
+    // reuse.
+    void reset() {
+        while (chunks_) {
+            Chunk* next = chunks_->next;
+            chunks_->next = spare_;
+            spare_ = chunks_;
+            chunks_ = next;
+        }
+        freeChunks(&large_);
+        cursor_ = 0;
+        limit_ = 0;
+    }
+
+    // Invalidate every allocation, and free all memory.
+    void release() {
+        freeChunks(&chunks_);
+        freeChunks(&spare_);
+        freeChunks(&large_);
+        cursor_ = 0;
+        limit_ = 0;
+    }
+
+    // Bytes held in chunks, whether in use or not.
+    size_t memoryUse() const {
+        return bytes_;
+    }
+
+    AllocPolicy& allocPolicy() {
+        return *this;
+    }
+
+  private:
+    static uintptr_t alignUp(uintptr_t value, size_t alignment) {
+        return (value + alignment - 1) & ~uintptr_t(alignment - 1);
+    }
+    static uintptr_t start(Chunk* chunk) {
+        return reinterpret_cast<uintptr_t>(chunk) + kChunkHeader;
+    }
+
+    // Make a fresh standard chunk current, reusing a spare one if possible.
+    bool nextChunk() {
+        Chunk* chunk = spare_;
+        if (chunk) {
+            spare_ = chunk->next;
+        } else {
+            chunk = newChunk(chunkSize_);
+            if (!chunk)
+                return false;
+        }
+        chunk->next = chunks_;
+        chunks_ = chunk;
+        cursor_ = start(chunk);
+        limit_ = reinterpret_cast<uintptr_t>(chunk) + chunkSize_;
+        return true;
+    }
+
+    Chunk* newChunk(size_t bytes) {
+        Chunk* chunk = (Chunk*)this->am_malloc(bytes);
+        if (!chunk)
+            return nullptr;
+        chunk->bytes = bytes;
+        bytes_ += bytes;
+        return chunk;
+    }
+
+    void freeChunks(Chunk** list) {
+        while (*list) {
+            Chunk* next = (*list)->next;
+            bytes_ -= (*list)->bytes;
+            this->am_free(*list);
+            *list = next;
+        }
+    }
+
+  private:
+    Arena(const Arena& other) = delete;
+    Arena& operator =(const Arena& other) = delete;
+
+  private:
+    size_t chunkSize_;
+    Chunk* chunks_;
+    Chunk* spare_;
+    Chunk* large_;
+    uintptr_t cursor_;
+    uintptr_t limit_;
+    size_t bytes_;
+};
+
+// An allocator policy that takes memory from an Arena, for containers that
+// are thrown away together. am_free() does nothing: memory comes back when
+// the arena is reset or released, which must not happen while a container
+// using it is still alive.
+//
+// Containers that grow leave their old buffers behind in the arena, so it
+// is best to reserve() them up front.
+class ArenaAllocatorPolicy
+{
+  public:
+    explicit ArenaAllocatorPolicy(Arena<>* arena)
+     : arena_(arena)
+    {}
+
+    void reportOutOfMemory() {
+        fprintf(stderr, "OUT OF MEMORY\n");
+        abort();
+    }
+    void reportAllocationOverflow() {
+        fprintf(stderr, "OUT OF MEMORY\n");
+        abort();
+    }
+
+    void am_free(void* memory) {
+    }
+    void* am_malloc(size_t bytes) {
+        return arena_->allocate(bytes);
+    }
+    void* am_malloc_aligned(size_t bytes, size_t alignment) {
+        return arena_->allocate(bytes, alignment);
+    }
+    void* am_realloc(void* ptr, size_t oldBytes, size_t newBytes) {
+        return arena_->reallocate(ptr, oldBytes, newBytes);
+    }
+
+    Arena<>* arena() const {
+        return arena_;
+    }
+
+    bool operator ==(const ArenaAllocatorPolicy& other) const {
+        return arena_ == other.arena_;
+    }
+    bool operator !=(const ArenaAllocatorPolicy& other) const {
+        return arena_ != other.arena_;
+    }
+
+  private:
+    Arena<>* arena_;
+};
+
+namespace detail {
+
+template <typename AllocPolicy>
+static inline bool
+SameAllocPolicy(const AllocPolicy& a, const AllocPolicy& b, std::true_type)
+{
+    return true;
+}
+
+template <typename AllocPolicy>
+static inline bool
+SameAllocPolicy(const AllocPolicy& a, const AllocPolicy& b, std::false_type)
+{
+    return a == b;
+}
+
+} // namespace detail
+
+// Adapts an allocator policy to the standard Allocator requirements, so that
+// std::vector, std::deque and the like can take their memory from an arena
+// or pool. A policy with state must be comparable with ==, and two policies
+// must compare equal only if one can free the other's memory.
+//
+// Standard containers cannot cope with failure, so running out of memory
+// aborts once the policy has reported it.
+template <typename T, typename AllocPolicy = SystemAllocatorPolicy>
+class StdAllocator : private AllocPolicy
+{
+    template <typename U, typename OtherPolicy>
+    friend class StdAllocator;
+
+  public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+    typedef typename std::is_empty<AllocPolicy>::type is_always_equal;
+
+    template <typename U>
+    struct rebind {
+        typedef StdAllocator<U, AllocPolicy> other;
+    };
+
+    StdAllocator()
+    {}
+    explicit StdAllocator(const AllocPolicy& ap)
+     : AllocPolicy(ap)
+    {}
+    template <typename U>
+    StdAllocator(const StdAllocator<U, AllocPolicy>& other)
+     : AllocPolicy(other.allocPolicy())
+    {}
+
+    T* allocate(size_t n) {
+        if (n > SIZE_MAX / sizeof(T)) {
+            this->reportAllocationOverflow();
+            abort();
+        }
+        void* ptr = AllocPolicyTraits<AllocPolicy>::allocate(this, n * sizeof(T), alignof(T));
+        if (!ptr) {
+            this->reportOutOfMemory();
+            abort();
+        }
+        return static_cast<T*>(ptr);
+    }
+    void deallocate(T* ptr, size_t n) {
+        AllocPolicyTraits<AllocPolicy>::release(this, ptr, n * sizeof(T), alignof(T));
+    }
+
+    const AllocPolicy& allocPolicy() const {
+        return *this;
+    }
+
+    template <typename U>
+    bool operator ==(const StdAllocator<U, AllocPolicy>& other) const {
+        return detail::SameAllocPolicy(allocPolicy(), other.allocPolicy(),
+                                       typename std::is_empty<AllocPolicy>::type());
+    }
+    template <typename U>
+    bool operator !=(const StdAllocator<U, AllocPolicy>& other) const {
+        return !(*this == other);
+    }
 };
 
 } // namespace ke
@@ -0,0 +1,219 @@
+// vim: set sts=8 ts=4 sw=4 tw=99 et:
+//
+// Copyright (C) 2026 David Anderson and AlliedModders LLC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of AlliedModders LLC nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+
+#include <amtl/am-allocator-policies.h>
+#include <amtl/am-hashed-string.h>
+#include <amtl/am-hashset.h>
+
+namespace ke {
+
+namespace detail {
+
+// The interned form of a string. These live in an AtomTable's arena, and
+// are never moved or freed until the table is destroyed.
+struct AtomData {
+    uint64_t hash;
+    size_t length;
+    char chars[1];
+};
+
+} // namespace detail
+
+// A handle to an interned string. Atoms are the size of a pointer, and two
+// atoms from the same AtomTable are equal exactly when their strings are, so
+// comparing and hashing them is O(1). A default-constructed Atom is null.
+//
+// An Atom is valid for as long as the AtomTable that created it.
+class Atom
+{
+  public:
+    Atom()
+     : data_(nullptr)
+    {}
+    explicit Atom(const detail::AtomData* data)
+     : data_(data)
+    {}
+
+    // Always null-terminated.
+    const char* chars() const {
+        assert(data_);
+        return data_->chars;
+    }
+    size_t length() const {
+        assert(data_);
+        return data_->length;
+    }
+    uint32_t hash() const {
+        assert(data_);
+        return uint32_t(data_->hash);
+    }
+
+    explicit operator bool() const {
+        return !!data_;
+    }
+    bool operator ==(const Atom& other) const {
+        return data_ == other.data_;
+    }
+    bool operator !=(const Atom& other) const {
+        return data_ != other.data_;
+    }
+
+  private:
+    const detail::AtomData* data_;
+};
+
+// A HashPolicy for maps and sets keyed by Atom.
+struct AtomPolicy {
+    static inline uint32_t hash(const Atom& atom) {
+        return atom.hash();
+    }
+    static inline bool matches(const Atom& find, const Atom& key) {
+        return find == key;
+    }
+};
+
+// A thread-safe table of interned strings. The bytes of each string are
+// copied into a chunked arena, so they are stored contiguously and are only
+// freed, all at once, when the table is destroyed.
+//
+// Interning a string that is already present only takes a shared lock, so
+// many threads can intern known names concurrently. Using the resulting
+// Atoms needs no locking at all.
+template <typename AllocPolicy = SystemAllocatorPolicy>
+class AtomTable
+{
+    typedef detail::AtomData AtomData;
+
+    struct Policy {
+        static inline uint64_t hash(const HashedString& key) {
+            return key.hash();
+        }
+        static inline bool matches(const HashedString& key, const AtomData* data) {
+            return key.hash() == data->hash && key.length() == data->length &&
+                   memcmp(key.chars(), data->chars, data->length) == 0;
+        }
+    };
+
+    typedef HashSet<const AtomData*, Policy, AllocPolicy> Set;
+
+  public:
+    static const size_t kChunkSize = Arena<AllocPolicy>::kDefaultChunkSize;
+
+    explicit AtomTable(AllocPolicy ap = AllocPolicy())
+     : set_(ap),
+       arena_(kChunkSize, ap)
+    {}
+
+    bool init(size_t capacity = 16) {
+        return set_.init(capacity);
+    }
+
+    // Return the atom for a string, adding it if needed. Returns a null atom
+    // if out of memory.
+    Atom intern(const char* chars, size_t length) {
+        HashedString key(chars, length);
+        {
+            std::shared_lock<std::shared_timed_mutex> lock(lock_);
+            typename Set::Result r = set_.find(key.hash(), key);
+            if (r.found())
+                return Atom(*r);
+        }
+
+        std::lock_guard<std::shared_timed_mutex> lock(lock_);
+        typename Set::Insert i = set_.findForAdd(key.hash(), key);
+        if (i.found())
+            return Atom(*i);
+
+        size_t bytes = offsetof(AtomData, chars) + length + 1;
+        AtomData* data = (AtomData*)arena_.allocate(bytes, alignof(AtomData));
+        if (!data)
+            return Atom();
+        data->hash = key.hash();
+        data->length = length;
+        memcpy(data->chars, chars, length);
+        data->chars[length] = '\0';
+
+        if (!set_.add(i, data))
+            return Atom();
+        return Atom(data);
+    }
+    Atom intern(const char* chars) {
+        return intern(chars, strlen(chars));
+    }
+    Atom intern(const std::string& str) {
+        return intern(str.c_str(), str.size());
+    }
+
+    // Return the atom for a string if it has been interned, or a null atom.
+    Atom find(const char* chars, size_t length) {
+        HashedString key(chars, length);
+        std::shared_lock<std::shared_timed_mutex> lock(lock_);
+        typename Set::Result r = set_.find(key.hash(), key);
+        return r.found() ? Atom(*r) : Atom();
+    }
+    Atom find(const char* chars) {
+        return find(chars, strlen(chars));
+    }
+    Atom find(const std::string& str) {
+        return find(str.c_str(), str.size());
+    }
+
+    size_t elements() {
+        std::shared_lock<std::shared_timed_mutex> lock(lock_);
+        return set_.elements();
+    }
+
+    // Memory held by the arena and the index.
+    size_t estimateMemoryUse() {
+        std::shared_lock<std::shared_timed_mutex> lock(lock_);
+        return arena_.memoryUse() + set_.estimateMemoryUse();
+    }
+
+  private:
+    AtomTable(const AtomTable& other) = delete;
+    AtomTable& operator =(const AtomTable& other) = delete;
+
+  private:
+    std::shared_timed_mutex lock_;
+    Set set_;
+    Arena<AllocPolicy> arena_;
+};
+
+} // namespace ke
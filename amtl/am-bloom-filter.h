@@ -0,0 +1,219 @@
+// vim: set sts=8 ts=4 sw=4 tw=99 et:
+//
+// Copyright (C) 2026 David Anderson and AlliedModders LLC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of AlliedModders LLC nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <assert.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <utility>
+
+#include <amtl/am-allocator-policies.h>
+#include <amtl/am-bits.h>
+#include <amtl/am-hashtable.h>
+
+namespace ke {
+
+// A probabilistic set, for cheaply rejecting keys that are not in a larger
+// structure. mayContain() never returns false for a key that was added, and
+// returns true for a key that was not added with about the probability
+// given to init().
+//
+// This is a split-block Bloom filter[1]: each key maps to one 32-byte block,
+// and sets one bit in each of the block's eight 32-bit words. A query reads
+// a single block, so it costs at most one cache miss, however large the
+// filter is.
+//
+// HashPolicy needs only the hash() functions of a HashTable policy, so the
+// policy of the HashMap or HashSet being fronted can be reused directly. A
+// typical use is to check the filter before probing a large map that
+// usually misses:
+//
+//     if (!filter.mayContain(key))
+//         return nullptr;
+//     auto r = map.find(key);
+//
+// Keys cannot be removed. If many keys are removed from the fronted map,
+// the filter still works, but rejects fewer misses until it is rebuilt.
+//
+// [1] Putze, Sanders, and Singler, "Cache-, Hash- and Space-Efficient Bloom
+//     Filters", and the Parquet split-block Bloom filter specification.
+template <typename HashPolicy, typename AllocPolicy = SystemAllocatorPolicy>
+class BloomFilter : private AllocPolicy
+{
+    static const size_t kWordsPerBlock = 8;
+    static const size_t kBlockBytes = kWordsPerBlock * sizeof(uint32_t);
+
+    struct Block {
+        uint32_t words[kWordsPerBlock];
+    };
+
+  public:
+    explicit BloomFilter(AllocPolicy ap = AllocPolicy())
+     : AllocPolicy(ap),
+       blocks_(nullptr),
+       nblocks_(0)
+    {}
+
+    BloomFilter(BloomFilter&& other)
+     : AllocPolicy(std::move(other)),
+       blocks_(other.blocks_),
+       nblocks_(other.nblocks_)
+    {
+        other.blocks_ = nullptr;
+        other.nblocks_ = 0;
+    }
+
+    ~BloomFilter() {
+        AllocPolicyTraits<AllocPolicy>::release(this, blocks_, nblocks_ * kBlockBytes,
+                                                kBlockBytes);
+    }
+
+    // Size the filter for |expected| keys, with a false positive rate of
+    // |rate| (between 0 and 1) once they have all been added. Adding more
+    // keys than expected raises the rate. Any existing keys are cleared.
+    bool init(size_t expected, double rate = 0.01) {
+        assert(rate > 0 && rate < 1);
+
+        double bitsPerKey = BitsPerKey(rate);
+        double blocks = ceil(double(expected) * bitsPerKey / (kBlockBytes * 8));
+        if (blocks > double(SIZE_MAX / kBlockBytes - 1)) {
+            this->reportAllocationOverflow();
+            return false;
+        }
+        size_t nblocks = blocks < 1 ? 1 : size_t(blocks);
+
+        // Blocks are aligned so that none straddles a cache line.
+        Block* memory = (Block*)AllocPolicyTraits<AllocPolicy>::allocate(
+            this, nblocks * kBlockBytes, kBlockBytes);
+        if (!memory)
+            return false;
+
+        AllocPolicyTraits<AllocPolicy>::release(this, blocks_, nblocks_ * kBlockBytes,
+                                                kBlockBytes);
+        blocks_ = memory;
+        nblocks_ = nblocks;
+        clear();
+        return true;
+    }
+
+    template <typename Key>
+    void add(const Key& key) {
+        uint64_t hash = hashOf(key);
+        Block& block = blocks_[blockOf(hash)];
+        for (size_t i = 0; i < kWordsPerBlock; i++)
+            block.words[i] |= bitOf(hash, i);
+    }
+
+    template <typename Key>
+    bool mayContain(const Key& key) const {
+        uint64_t hash = hashOf(key);
+        const Block& block = blocks_[blockOf(hash)];
+        uint32_t missing = 0;
+        for (size_t i = 0; i < kWordsPerBlock; i++)
+            missing |= bitOf(hash, i) & ~block.words[i];
+        return !missing;
+    }
+
+    void clear() {
+        if (blocks_)
+            memset(blocks_, 0, nblocks_ * kBlockBytes);
+    }
+
+    size_t estimateMemoryUse() const {
+        return nblocks_ * kBlockBytes;
+    }
+
+    AllocPolicy& allocPolicy() {
+        return *this;
+    }
+
+    // The expected false positive rate with |bitsPerKey| bits of filter per
+    // added key. The number of keys landing in a block is roughly Poisson
+    // distributed, and a block holding j keys gives a false positive when
+    // all eight probed bits were set by them.
+    static double FalsePositiveRate(double bitsPerKey) {
+        const double kBlockBits = kBlockBytes * 8;
+        double mean = kBlockBits / bitsPerKey;
+        double p = exp(-mean);
+        double rate = 0;
+        for (size_t j = 1; j < size_t(mean * 4) + 64; j++) {
+            p *= mean / double(j);
+            rate += p * pow(1 - pow(1 - 1.0 / 32, double(j)), double(kWordsPerBlock));
+        }
+        return rate;
+    }
+
+    // The fewest bits per key that give at most |rate| false positives,
+    // found by bisection over FalsePositiveRate().
+    static double BitsPerKey(double rate) {
+        double low = 1, high = 64;
+        while (high - low > 0.05) {
+            double mid = (low + high) / 2;
+            if (FalsePositiveRate(mid) <= rate)
+                high = mid;
+            else
+                low = mid;
+        }
+        return high;
+    }
+
+  private:
+    // Policies may return 32- or 64-bit hashes. Either way, mix them into
+    // 64 bits: the high half picks the block, and the low half the bits.
+    template <typename Key>
+    static uint64_t hashOf(const Key& key) {
+        uint64_t hash = uint64_t(HashPolicy::hash(key)) * 0x9E3779B97F4A7C15ull;
+        return hash ^ (hash >> 29);
+    }
+    size_t blockOf(uint64_t hash) const {
+        return size_t(((hash >> 32) * uint64_t(nblocks_)) >> 32);
+    }
+    static uint32_t bitOf(uint64_t hash, size_t word) {
+        static const uint32_t kSalts[kWordsPerBlock] = {
+            0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+            0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U,
+        };
+        return uint32_t(1) << ((uint32_t(hash) * kSalts[word]) >> 27);
+    }
+
+  private:
+    BloomFilter(const BloomFilter& other) = delete;
+    BloomFilter& operator =(const BloomFilter& other) = delete;
+
+  private:
+    Block* blocks_;
+    size_t nblocks_;
+};
+
+} // namespace ke
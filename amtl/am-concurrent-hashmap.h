@@ -0,0 +1,323 @@
+// vim: set sts=8 ts=4 sw=4 tw=99 et:
+//
+// Copyright (C) 2026 David Anderson and AlliedModders LLC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of AlliedModders LLC nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <amtl/am-bits.h>
+#include <amtl/am-hashmap.h>
+
+namespace ke {
+
+// A HashMap that can be shared between threads. Entries are split across a
+// power-of-two number of shards, each of which is an independent HashMap
+// guarded by its own reader/writer lock, so threads only contend when they
+// touch the same shard. The shard is picked from the high bits of the key's
+// hash after mixing it to 64 bits, so it is independent of the low bits the
+// shard's own table uses, and every bit of a 64-bit hash (see HashWidth)
+// takes part.
+//
+// Result and Insert hold their shard's lock (shared and exclusive,
+// respectively) for as long as they are alive, so they should be kept
+// short-lived, and a thread must not hold two of them at once. Where
+// possible, prefer the helpers that copy values out, such as get(),
+// getOrInsert() and computeIfAbsent(), which never hold a lock beyond the
+// call.
+//
+// The template parameters are the same as for HashMap.
+template <typename K, typename V, typename HashPolicy, typename AllocPolicy = SystemAllocatorPolicy>
+class ConcurrentHashMap
+{
+    typedef HashMap<K, V, HashPolicy, AllocPolicy> Map;
+    typedef typename Map::HashCode HashCode;
+    typedef std::shared_timed_mutex Lock;
+
+    struct Shard {
+        explicit Shard(AllocPolicy ap)
+         : map(ap)
+        {}
+
+        Lock lock;
+        Map map;
+    };
+
+  public:
+    static const size_t kDefaultShards = 16;
+
+    explicit ConcurrentHashMap(AllocPolicy ap = AllocPolicy())
+     : ap_(ap),
+       shift_(32)
+    {}
+
+    // |shards| must be a power of two, as must |capacity|, which is the
+    // initial capacity of each shard.
+    bool init(size_t shards = kDefaultShards, size_t capacity = 16) {
+        assert(shards_.empty());
+        assert(IsPowerOfTwo(shards) && shards <= (size_t(1) << 16));
+
+        shards_.reserve(shards);
+        for (size_t i = 0; i < shards; i++) {
+            shards_.emplace_back(new Shard(ap_));
+            if (!shards_.back()->map.init(capacity))
+                return false;
+        }
+        shift_ = 32 - Log2(uint32_t(shards));
+        return true;
+    }
+
+    // Ensure each shard can hold its share of |count| entries without
+    // growing, allowing some slack for an uneven spread of keys.
+    bool reserve(size_t count) {
+        assert(!shards_.empty());
+        if (shards_.empty())
+            return false;
+
+        size_t perShard = count / shards_.size();
+        perShard += perShard / 8 + 1;
+        for (const auto& shard : shards_) {
+            std::unique_lock<Lock> lock(shard->lock);
+            if (!shard->map.reserve(perShard))
+                return false;
+        }
+        return true;
+    }
+
+    // The result of find(). This holds a shared lock on the key's shard, so
+    // the entry is read-only; use findForAdd() to change a value.
+    class Result
+    {
+        friend class ConcurrentHashMap;
+
+        typedef typename Map::Result MapResult;
+        typedef typename std::remove_reference<decltype(*std::declval<MapResult>())>::type Entry;
+
+        std::shared_lock<Lock> lock_;
+        mutable MapResult r_;
+
+        Result(std::shared_lock<Lock>&& lock, const MapResult& r)
+         : lock_(std::move(lock)),
+           r_(r)
+        {}
+
+      public:
+        const Entry* operator ->() const {
+            return &*r_;
+        }
+        const Entry& operator *() const {
+            return *r_;
+        }
+
+        bool found() const {
+            return r_.found();
+        }
+    };
+
+    // The result of findForAdd(). This holds an exclusive lock on the key's
+    // shard, so other threads cannot add the same key until it is destroyed.
+    class Insert
+    {
+        friend class ConcurrentHashMap;
+
+        std::unique_lock<Lock> lock_;
+        Map* map_;
+        typename Map::Insert i_;
+
+        Insert(std::unique_lock<Lock>&& lock, Map* map, const typename Map::Insert& i)
+         : lock_(std::move(lock)),
+           map_(map),
+           i_(i)
+        {}
+
+      public:
+        typename Map::Insert& operator ->() {
+            return i_;
+        }
+        auto operator *() -> decltype(*i_) {
+            return *i_;
+        }
+
+        bool found() const {
+            return i_.found();
+        }
+    };
+
+    template <typename Lookup>
+    Result find(const Lookup& key) const {
+        HashCode hash = HashPolicy::hash(key);
+        Shard& shard = shardFor(hash);
+        std::shared_lock<Lock> lock(shard.lock);
+        typename Map::Result r = shard.map.find(hash, key);
+        return Result(std::move(lock), r);
+    }
+
+    template <typename Lookup>
+    Insert findForAdd(const Lookup& key) {
+        HashCode hash = HashPolicy::hash(key);
+        Shard& shard = shardFor(hash);
+        std::unique_lock<Lock> lock(shard.lock);
+        typename Map::Insert i = shard.map.findForAdd(hash, key);
+        return Insert(std::move(lock), &shard.map, i);
+    }
+
+    // As with HashMap, |i| must be the result of findForAdd() for |key|. The
+    // Insert object is still valid after add() returns.
+    template <typename UK, typename UV>
+    bool add(Insert& i, UK&& key, UV&& value) {
+        return i.map_->add(i.i_, std::forward<UK>(key), std::forward<UV>(value));
+    }
+    template <typename UK>
+    bool add(Insert& i, UK&& key) {
+        return i.map_->add(i.i_, std::forward<UK>(key));
+    }
+
+    template <typename Lookup>
+    bool contains(const Lookup& key) const {
+        return find(key).found();
+    }
+
+    // Copy the value for |key| into |out|, returning false if there is none.
+    template <typename Lookup>
+    bool get(const Lookup& key, V* out) const {
+        Result r = find(key);
+        if (!r.found())
+            return false;
+        *out = r->value;
+        return true;
+    }
+
+    // Add |value| under |key| unless the key is already present. Returns a
+    // copy of the value in the map, or |value| if the map ran out of memory.
+    template <typename UK, typename UV>
+    V getOrInsert(UK&& key, UV&& value) {
+        Insert i = findForAdd(key);
+        if (i.found())
+            return i->value;
+        // A failed emplace() leaves |value| untouched.
+        if (!i.map_->emplace(i.i_, std::forward<UK>(key), std::forward<UV>(value)))
+            return V(std::forward<UV>(value));
+        return i->value;
+    }
+
+    // If |key| is not present, add the result of calling |compute()|. The
+    // shard stays locked while |compute| runs, so it is called at most once
+    // per key, and must not use this map. Returns a copy of the value in the
+    // map, or the computed value if the map ran out of memory.
+    template <typename UK, typename Compute>
+    V computeIfAbsent(UK&& key, Compute compute) {
+        Insert i = findForAdd(key);
+        if (i.found())
+            return i->value;
+        V value = compute();
+        if (!add(i, std::forward<UK>(key), value))
+            return value;
+        return i->value;
+    }
+
+    template <typename Lookup>
+    void removeIfExists(const Lookup& key) {
+        HashCode hash = HashPolicy::hash(key);
+        Shard& shard = shardFor(hash);
+        std::unique_lock<Lock> lock(shard.lock);
+        typename Map::Result r = shard.map.find(hash, key);
+        if (r.found())
+            shard.map.remove(r);
+    }
+
+    // Call |fn(key, value)| for every entry. Each shard is locked while it is
+    // visited, so entries added or removed concurrently may or may not be
+    // seen, and |fn| must not use this map. The lock is exclusive, since
+    // iterating may finish an incremental resize, so |fn| may modify values.
+    template <typename Fn>
+    void forEach(Fn fn) {
+        for (const auto& shard : shards_) {
+            std::unique_lock<Lock> lock(shard->lock);
+            for (auto iter = shard->map.iter(); !iter.empty(); iter.next())
+                fn(iter->key, iter->value);
+        }
+    }
+
+    void clear() {
+        for (const auto& shard : shards_) {
+            std::unique_lock<Lock> lock(shard->lock);
+            shard->map.clear();
+        }
+    }
+
+    // This is only a snapshot if other threads are adding or removing entries.
+    size_t elements() const {
+        size_t count = 0;
+        for (const auto& shard : shards_) {
+            std::shared_lock<Lock> lock(shard->lock);
+            count += shard->map.elements();
+        }
+        return count;
+    }
+
+    size_t estimateMemoryUse() const {
+        size_t bytes = 0;
+        for (const auto& shard : shards_) {
+            std::shared_lock<Lock> lock(shard->lock);
+            bytes += sizeof(Shard) + shard->map.estimateMemoryUse();
+        }
+        return bytes;
+    }
+
+    size_t shards() const {
+        return shards_.size();
+    }
+
+  private:
+    // The key is hashed once, here, and the hash is passed on to the shard.
+    Shard& shardFor(HashCode hash) const {
+        assert(!shards_.empty());
+        uint64_t mixed = uint64_t(hash) * 0x9E3779B97F4A7C15ull;
+        return *shards_[size_t((mixed >> 32) >> shift_)];
+    }
+
+  private:
+    ConcurrentHashMap(const ConcurrentHashMap& other) = delete;
+    ConcurrentHashMap& operator =(const ConcurrentHashMap& other) = delete;
+
+  private:
+    AllocPolicy ap_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    uint32_t shift_;
+};
+
+} // namespace ke
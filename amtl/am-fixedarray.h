@@ -30,7 +30,11 @@
 #define _include_amtl_fixedarray_h_
 
 #include <assert.h>
+#include <stdint.h>
 
+#include <new>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include <amtl/am-allocator-policies.h>
@@ -43,20 +47,26 @@ class FixedArray : private AllocPolicy
   public:
     FixedArray() : size_(0), data_(nullptr)
     {}
-    FixedArray(size_t size, AllocPolicy = AllocPolicy()) {
+    FixedArray(size_t size, AllocPolicy ap = AllocPolicy())
+     : AllocPolicy(ap)
+    {
         if (!allocate(size))
             return;
         for (size_t i = 0; i < size_; i++)
             new (&data_[i]) T();
     }
-    FixedArray(const FixedArray& other) {
+    FixedArray(const FixedArray& other)
+     : AllocPolicy(other)
+    {
         if (!allocate(other.size()))
             return;
         for (size_t i = 0; i < size_; i++)
             new (&data_[i]) T(other[i]);
     }
 
-    FixedArray(FixedArray&& other) {
+    FixedArray(FixedArray&& other)
+     : AllocPolicy(std::move(other))
+    {
         size_ = other.size_;
         data_ = other.data_;
         other.size_ = 0;
@@ -91,6 +101,55 @@ class FixedArray : private AllocPolicy
         return size_ == 0 || !!data_;
     }
 
+    // Change the number of elements, keeping those that fit and
+    // default-constructing any new ones. Trivially relocatable elements are
+    // moved with realloc, which may grow the array in place. On failure the
+    // array is unchanged.
+    bool resize(size_t size) {
+        if (size == size_)
+            return true;
+        if (size == 0) {
+            destruct();
+            deallocate();
+            data_ = nullptr;
+            size_ = 0;
+            return true;
+        }
+        if (size > SIZE_MAX / sizeof(T)) {
+            this->reportAllocationOverflow();
+            return false;
+        }
+
+        // Shrinking with realloc would have to destroy the dropped elements
+        // before knowing that it can succeed, so it is only done when that
+        // is a no-op.
+        T* data;
+        size_t kept = size < size_ ? size : size_;
+        if (IsTriviallyRelocatable<T>::value &&
+            (size > size_ || std::is_trivially_destructible<T>::value))
+        {
+            data = (T*)AllocPolicyTraits<AllocPolicy>::reallocate(
+                this, data_, sizeof(T) * size_, sizeof(T) * size, alignof(T));
+            if (!data)
+                return false;
+        } else {
+            data = (T*)AllocPolicyTraits<AllocPolicy>::allocate(this, sizeof(T) * size,
+                                                                alignof(T));
+            if (!data)
+                return false;
+            for (size_t i = 0; i < kept; i++)
+                new (&data[i]) T(std::move(data_[i]));
+            destruct();
+            deallocate();
+        }
+
+        for (size_t i = kept; i < size; i++)
+            new (&data[i]) T();
+        data_ = data;
+        size_ = size;
+        return true;
+    }
+
     size_t size() const {
         return size_;
     }
@@ -137,6 +196,7 @@ class FixedArray : private AllocPolicy
     FixedArray& operator =(FixedArray&& other) {
         destruct();
         deallocate();
+        AllocPolicy::operator =(std::move(other));
         size_ = other.size_;
         data_ = other.data_;
         other.size_ = 0;
@@ -163,7 +223,7 @@ class FixedArray : private AllocPolicy
         if (size == 0)
             data_ = nullptr;
         else
-            data_ = (T*)this->am_malloc(sizeof(T) * size_);
+            data_ = (T*)AllocPolicyTraits<AllocPolicy>::allocate(this, sizeof(T) * size_, alignof(T));
         return !!data_;
     }
     void destruct() {
@@ -171,7 +231,7 @@ class FixedArray : private AllocPolicy
             data_[i].~T();
     }
     void deallocate() {
-        this->am_free(data_);
+        AllocPolicyTraits<AllocPolicy>::release(this, data_, sizeof(T) * size_, alignof(T));
     }
 
   private:
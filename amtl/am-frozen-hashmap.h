@@ -0,0 +1,275 @@
+// vim: set sts=8 ts=4 sw=4 tw=99 et:
+//
+// Copyright (C) 2026 David Anderson and AlliedModders LLC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of AlliedModders LLC nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <type_traits>
+#include <vector>
+
+#include <amtl/am-bits.h>
+#include <amtl/am-hashmap.h>
+#include <amtl/am-hashtable.h>
+
+namespace ke {
+
+namespace detail {
+
+// The start of a frozen map image. All offsets are from the start of the
+// image, so it can be loaded at any address.
+struct FrozenHashMapHeader {
+    char magic[4];
+    // kFrozenByteOrder, as written by the machine that froze the map. It
+    // reads back differently on a machine of the other endianness.
+    uint32_t byteOrder;
+    uint32_t version;
+    uint32_t entrySize;
+    uint32_t keySize;
+    uint32_t valueSize;
+    uint64_t capacity;
+    uint64_t elements;
+    uint64_t ctrlOffset;
+    uint64_t entriesOffset;
+    uint64_t length;
+};
+
+static const char kFrozenMagic[4] = {'A', 'M', 'F', 'H'};
+static const uint32_t kFrozenByteOrder = 0x01020304;
+static const uint32_t kFrozenVersion = 1;
+
+} // namespace detail
+
+// A read-only hash map stored in a flat, position-independent image, which
+// is built once from a HashMap with Freeze(). The image can be written to
+// disk, then memory-mapped (or read) and queried directly: init() validates
+// the header and scans the control bytes once, and lookups neither parse nor
+// allocate.
+//
+// The image has a header, an array of control bytes in the format used by
+// HashStorage::ControlBytes, and an array of entries. Keys and values are
+// copied byte-for-byte, so they must be trivially copyable, and must not
+// contain pointers. init() rejects images from a different format version,
+// a machine of different endianness, or with different key or value sizes.
+// HashPolicy::hash() must give the same results in the process that froze
+// the map and the one reading it.
+template <typename K, typename V, typename HashPolicy>
+class FrozenHashMap
+{
+    static_assert(std::is_trivially_copyable<K>::value && std::is_trivially_copyable<V>::value,
+                  "FrozenHashMap keys and values must be trivially copyable");
+
+    typedef detail::FrozenHashMapHeader Header;
+    typedef detail::HashControlGroup Group;
+
+    // Sections of the image start at this alignment, which is also the
+    // alignment the image itself needs.
+    static const size_t kAlignment = 16;
+
+  public:
+    struct Entry {
+        K key;
+        V value;
+    };
+
+    static_assert(alignof(Entry) <= kAlignment, "FrozenHashMap entries are over-aligned");
+
+    FrozenHashMap()
+     : ctrl_(nullptr),
+       entries_(nullptr),
+       capacity_(0),
+       elements_(0)
+    {}
+
+    // Build an image of |map|, replacing the contents of |image|. The image
+    // is filled to at most 7/8ths, since it never changes.
+    template <typename AllocPolicy>
+    static void Freeze(HashMap<K, V, HashPolicy, AllocPolicy>* map, std::vector<uint8_t>* image) {
+        uint64_t capacity = 16;
+        while (capacity - capacity / 8 < map->elements())
+            capacity *= 2;
+
+        Header header;
+        memcpy(header.magic, detail::kFrozenMagic, sizeof(header.magic));
+        header.byteOrder = detail::kFrozenByteOrder;
+        header.version = detail::kFrozenVersion;
+        header.entrySize = sizeof(Entry);
+        header.keySize = sizeof(K);
+        header.valueSize = sizeof(V);
+        header.capacity = capacity;
+        header.elements = map->elements();
+        header.ctrlOffset = Align(sizeof(Header), kAlignment);
+        header.entriesOffset = Align(header.ctrlOffset + capacity + Group::kWidth, kAlignment);
+        header.length = header.entriesOffset + capacity * sizeof(Entry);
+
+        image->assign(size_t(header.length), 0);
+        uint8_t* base = image->data();
+        memcpy(base, &header, sizeof(header));
+
+        uint8_t* ctrl = base + header.ctrlOffset;
+        uint8_t* entries = base + header.entriesOffset;
+        memset(ctrl, Group::kEmpty, size_t(capacity + Group::kWidth));
+
+        uint64_t mask = capacity - 1;
+        for (auto iter = map->iter(); !iter.empty(); iter.next()) {
+            uint64_t hash = mixHash(HashPolicy::hash(iter->key));
+            uint64_t index = hash & mask;
+            while (ctrl[index] != Group::kEmpty)
+                index = (index + 1) & mask;
+
+            ctrl[index] = tagOf(hash);
+            if (index < Group::kWidth)
+                ctrl[capacity + index] = tagOf(hash);
+
+            // Copy the key and value separately, so that padding in the
+            // image stays zeroed.
+            uint8_t* entry = entries + index * sizeof(Entry);
+            memcpy(entry + offsetof(Entry, key), &iter->key, sizeof(K));
+            memcpy(entry + offsetof(Entry, value), &iter->value, sizeof(V));
+        }
+    }
+
+    // Point the map at an image built by Freeze(). The image must stay
+    // alive, and unchanged, for as long as the map is used. Returns false
+    // if the image is malformed or incompatible.
+    bool init(const void* image, size_t length) {
+        const uint8_t* base = reinterpret_cast<const uint8_t*>(image);
+        if (reinterpret_cast<uintptr_t>(base) % kAlignment != 0 || length < sizeof(Header))
+            return false;
+
+        Header header;
+        memcpy(&header, base, sizeof(header));
+        if (memcmp(header.magic, detail::kFrozenMagic, sizeof(header.magic)) != 0 ||
+            header.byteOrder != detail::kFrozenByteOrder ||
+            header.version != detail::kFrozenVersion ||
+            header.entrySize != sizeof(Entry) ||
+            header.keySize != sizeof(K) ||
+            header.valueSize != sizeof(V))
+        {
+            return false;
+        }
+
+        // The entry array must end where the image does, which also bounds
+        // the control bytes before it.
+        uint64_t capacity = header.capacity;
+        if (capacity < Group::kWidth || capacity > SIZE_MAX / sizeof(Entry) ||
+            !IsPowerOfTwo(size_t(capacity)) || header.elements >= capacity ||
+            header.length != length ||
+            header.ctrlOffset < sizeof(Header) || header.ctrlOffset > length ||
+            header.ctrlOffset % kAlignment != 0 ||
+            header.entriesOffset % kAlignment != 0 ||
+            header.entriesOffset < header.ctrlOffset + capacity + Group::kWidth ||
+            header.entriesOffset > length ||
+            (length - header.entriesOffset) / sizeof(Entry) != capacity)
+        {
+            return false;
+        }
+
+        // Lookups stop at an empty slot, so the control bytes must agree with
+        // the element count, which leaves at least one slot empty. The
+        // trailing mirror of the first group must match it.
+        const uint8_t* ctrl = base + header.ctrlOffset;
+        uint64_t full = 0;
+        for (uint64_t i = 0; i < capacity; i++) {
+            if (!(ctrl[i] & 0x80))
+                full++;
+            else if (ctrl[i] != Group::kEmpty)
+                return false;
+        }
+        if (full != header.elements || memcmp(ctrl, ctrl + capacity, Group::kWidth) != 0)
+            return false;
+
+        ctrl_ = ctrl;
+        entries_ = reinterpret_cast<const Entry*>(base + header.entriesOffset);
+        capacity_ = size_t(capacity);
+        elements_ = size_t(header.elements);
+        return true;
+    }
+
+    // Returns the entry for |key|, or null if there is none.
+    template <typename Lookup>
+    const Entry* find(const Lookup& key) const {
+        if (!capacity_)
+            return nullptr;
+
+        uint64_t hash = mixHash(HashPolicy::hash(key));
+        uint8_t tag = tagOf(hash);
+        size_t mask = capacity_ - 1;
+        size_t pos = size_t(hash) & mask;
+        for (size_t probes = 0; probes < capacity_ / Group::kWidth; probes++) {
+            Group group(&ctrl_[pos]);
+            for (uint32_t bits = group.match(tag); bits; bits &= bits - 1) {
+                const Entry* entry = &entries_[(pos + FindRightmostBit(bits)) & mask];
+                if (HashPolicy::matches(key, entry->key))
+                    return entry;
+            }
+            if (group.matchEmpty())
+                return nullptr;
+            pos = (pos + Group::kWidth) & mask;
+        }
+        return nullptr;
+    }
+
+    template <typename Lookup>
+    bool contains(const Lookup& key) const {
+        return !!find(key);
+    }
+
+    // Call |fn(const Entry&)| for every entry, in an unspecified order.
+    template <typename Fn>
+    void forEach(Fn fn) const {
+        for (size_t i = 0; i < capacity_; i++) {
+            if (!(ctrl_[i] & 0x80))
+                fn(entries_[i]);
+        }
+    }
+
+    size_t elements() const {
+        return elements_;
+    }
+
+  private:
+    static uint64_t mixHash(uint64_t hash) {
+        return hash * 0x9E3779B97F4A7C15ull;
+    }
+    static uint8_t tagOf(uint64_t hash) {
+        return uint8_t(hash >> 57);
+    }
+
+  private:
+    const uint8_t* ctrl_;
+    const Entry* entries_;
+    size_t capacity_;
+    size_t elements_;
+};
+
+} // namespace ke
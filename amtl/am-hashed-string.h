@@ -0,0 +1,106 @@
+// vim: set sts=8 ts=4 sw=4 tw=99 et:
+//
+// Copyright (C) 2026 David Anderson and AlliedModders LLC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of AlliedModders LLC nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+
+#include <amtl/am-hashtable.h>
+
+namespace ke {
+
+// A reference to a string, along with its HashCharSequence64 hash, computed
+// once up front. Code that looks up the same name many times can build a
+// HashedString once and use it as the lookup key with a policy that accepts
+// it, such as StringHashPolicy, which then returns the saved hash instead of
+// hashing again. The characters are not copied, and must outlive the
+// HashedString.
+class HashedString
+{
+  public:
+    HashedString(const char* chars, size_t length)
+     : chars_(chars),
+       length_(length),
+       hash_(HashCharSequence64(chars, length))
+    {}
+    explicit HashedString(const char* chars)
+     : HashedString(chars, strlen(chars))
+    {}
+    explicit HashedString(const std::string& str)
+     : HashedString(str.c_str(), str.size())
+    {}
+
+    const char* chars() const {
+        return chars_;
+    }
+    size_t length() const {
+        return length_;
+    }
+    uint64_t hash() const {
+        return hash_;
+    }
+
+    bool operator ==(const std::string& other) const {
+        return length_ == other.size() && memcmp(chars_, other.c_str(), length_) == 0;
+    }
+
+  private:
+    const char* chars_;
+    size_t length_;
+    uint64_t hash_;
+};
+
+// A HashPolicy for std::string keys, which can be looked up by std::string,
+// C string, or HashedString, in a HashMap or HashSet. Hashes are
+// HashCharSequence64, truncated to the table's HashWidth.
+struct StringHashPolicy {
+    static inline uint64_t hash(const char* key) {
+        return HashCharSequence64(key, strlen(key));
+    }
+    static inline uint64_t hash(const std::string& key) {
+        return HashCharSequence64(key.c_str(), key.size());
+    }
+    static inline uint64_t hash(const HashedString& key) {
+        return key.hash();
+    }
+    static inline bool matches(const char* find, const std::string& key) {
+        return key.compare(find) == 0;
+    }
+    static inline bool matches(const std::string& find, const std::string& key) {
+        return find == key;
+    }
+    static inline bool matches(const HashedString& find, const std::string& key) {
+        return find == key;
+    }
+};
+
+} // namespace ke
@@ -30,6 +30,8 @@
 #ifndef _include_amtl_hashmap_h_
 #define _include_amtl_hashmap_h_
 
+#include <iterator>
+#include <type_traits>
 #include <utility>
 
 #include <amtl/am-hashtable.h>
@@ -43,12 +45,14 @@ namespace ke {
 // HashPolicy - A struct with a hash and comparator function for each lookup type:
 //     static uint32_t hash(const Type& value);
 //     static bool matches(const Type& value, const K& key);
+//     It may also have any of the optional HashTable policy members, such as
+//     kStorage (see am-hashtable.h).
 //
 // All types that match a given key, must compute the same hash.
 //
 // Note that like HashTable, a HashMap is not usable until init() has been called.
 template <typename K, typename V, typename HashPolicy, typename AllocPolicy = SystemAllocatorPolicy>
-class HashMap : private AllocPolicy
+class HashMap
 {
   private:
     struct Entry {
@@ -73,11 +77,11 @@ class HashMap : private AllocPolicy
         {}
     };
 
-    struct Policy {
+    struct Policy : public detail::HashPolicyOptions<HashPolicy> {
         typedef Entry Payload;
 
         template <typename Lookup>
-        static uint32_t hash(const Lookup& key) {
+        static auto hash(const Lookup& key) -> decltype(HashPolicy::hash(key)) {
             return HashPolicy::hash(key);
         }
 
@@ -103,9 +107,16 @@ class HashMap : private AllocPolicy
         return table_.init(capacity);
     }
 
+    // Ensure the map can hold |count| entries without growing. |count| does
+    // not need to be a power of two.
+    bool reserve(size_t count) {
+        return table_.reserve(count);
+    }
+
     typedef typename Internal::Result Result;
     typedef typename Internal::Insert Insert;
     typedef typename Internal::iterator iterator;
+    typedef typename Internal::HashCode HashCode;
 
     template <typename Lookup>
     Result find(const Lookup& key) const {
@@ -117,6 +128,26 @@ class HashMap : private AllocPolicy
         return table_.findForAdd(key);
     }
 
+    // Lookups with a precomputed hash; see HashTable::find(hash, key).
+    template <typename Lookup>
+    Result find(HashCode hash, const Lookup& key) const {
+        return table_.find(hash, key);
+    }
+    template <typename Lookup>
+    Insert findForAdd(HashCode hash, const Lookup& key) {
+        return table_.findForAdd(hash, key);
+    }
+
+    // Batched find(); see HashTable::findMany().
+    template <typename LookupIter, typename OutIter>
+    OutIter findMany(LookupIter begin, LookupIter end, OutIter out) const {
+        return table_.findMany(begin, end, out);
+    }
+    template <typename Range, typename OutIter>
+    OutIter findMany(const Range& keys, OutIter out) const {
+        return table_.findMany(std::begin(keys), std::end(keys), out);
+    }
+
     template <typename Lookup>
     void removeIfExists(const Lookup& key) {
         return table_.removeIfExists(key);
@@ -139,6 +170,15 @@ class HashMap : private AllocPolicy
         return table_.add(i, std::move(entry));
     }
 
+    // As add(), but the entry is constructed in place once there is room for
+    // it, so |key| and |value| are left untouched if the map runs out of
+    // memory. Since the table may be resized first, they must not refer into
+    // this map.
+    template <typename UK, typename UV>
+    bool emplace(Insert& i, UK&& key, UV&& value) {
+        return table_.add(i, std::forward<UK>(key), std::forward<UV>(value));
+    }
+
     // This can be used to avoid compiler constructed temporaries, since AMTL
     // does not yet support move semantics. If you use this, the key and value
     // must be set after.
@@ -146,6 +186,24 @@ class HashMap : private AllocPolicy
         return table_.add(i);
     }
 
+    // Add every entry in a range of pairs (anything with |first| and
+    // |second| members, such as std::pair), skipping keys that are already
+    // present. With forward iterators, this is faster than adding the entries
+    // one at a time, since the map is reserved once and lookups are batched
+    // and prefetched. Single-pass input iterators are read once, adding one
+    // entry at a time.
+    template <typename Iter>
+    bool addAll(Iter begin, Iter end) {
+        typedef typename std::remove_reference<decltype(*begin)>::type Item;
+        return table_.addAll(begin, end,
+                             [](const Item& item) -> decltype((item.first)) { return item.first; },
+                             [](const Item& item) -> Entry { return Entry(item.first, item.second); });
+    }
+    template <typename Range>
+    bool addAll(const Range& range) {
+        return addAll(std::begin(range), std::end(range));
+    }
+
     iterator iter() {
         return iterator(&table_);
     }
@@ -162,11 +220,16 @@ class HashMap : private AllocPolicy
         return table_.estimateMemoryUse();
     }
 
+    // See HashTable::stats().
+    HashTableStats stats() const {
+        return table_.stats();
+    }
+
     AllocPolicy& allocPolicy() {
-        return *this;
+        return table_.allocPolicy();
     }
     const AllocPolicy& allocPolicy() const {
-        return *this;
+        return table_.allocPolicy();
     }
 
   private:
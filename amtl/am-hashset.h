@@ -30,6 +30,8 @@
 #ifndef _include_amtl_hashset_h_
 #define _include_amtl_hashset_h_
 
+#include <iterator>
+#include <type_traits>
 #include <utility>
 
 #include <amtl/am-hashtable.h>
@@ -42,16 +44,18 @@ namespace ke {
 // HashPolicy - A struct with a hash and comparator function for each lookup type:
 //    static uint32_t hash(const Type& value);
 //    static bool matches(const Type& value, const K& key);
+//    It may also have any of the optional HashTable policy members, such as
+//    kStorage (see am-hashtable.h).
 //
 // Like HashMap and HashTable, init() must be called to construct the set.
 template <typename K, typename HashPolicy, typename AllocPolicy = SystemAllocatorPolicy>
-class HashSet : private AllocPolicy
+class HashSet
 {
-    struct Policy {
+    struct Policy : public detail::HashPolicyOptions<HashPolicy> {
         typedef K Payload;
 
         template <typename Lookup>
-        static uint32_t hash(const Lookup& key) {
+        static auto hash(const Lookup& key) -> decltype(HashPolicy::hash(key)) {
             return HashPolicy::hash(key);
         }
 
@@ -77,9 +81,16 @@ class HashSet : private AllocPolicy
         return table_.init(capacity);
     }
 
+    // Ensure the set can hold |count| keys without growing. |count| does not
+    // need to be a power of two.
+    bool reserve(size_t count) {
+        return table_.reserve(count);
+    }
+
     typedef typename Internal::Result Result;
     typedef typename Internal::Insert Insert;
     typedef typename Internal::iterator iterator;
+    typedef typename Internal::HashCode HashCode;
 
     template <typename Lookup>
     Result find(const Lookup& key) {
@@ -91,6 +102,26 @@ class HashSet : private AllocPolicy
         return table_.findForAdd(key);
     }
 
+    // Lookups with a precomputed hash; see HashTable::find(hash, key).
+    template <typename Lookup>
+    Result find(HashCode hash, const Lookup& key) {
+        return table_.find(hash, key);
+    }
+    template <typename Lookup>
+    Insert findForAdd(HashCode hash, const Lookup& key) {
+        return table_.findForAdd(hash, key);
+    }
+
+    // Batched find(); see HashTable::findMany().
+    template <typename LookupIter, typename OutIter>
+    OutIter findMany(LookupIter begin, LookupIter end, OutIter out) {
+        return table_.findMany(begin, end, out);
+    }
+    template <typename Range, typename OutIter>
+    OutIter findMany(const Range& keys, OutIter out) {
+        return table_.findMany(std::begin(keys), std::end(keys), out);
+    }
+
     template <typename Lookup>
     void removeIfExists(const Lookup& key) {
         return table_.removeIfExists(key);
@@ -129,6 +160,11 @@ class HashSet : private AllocPolicy
         return table_.estimateMemoryUse();
     }
 
+    // See HashTable::stats().
+    HashTableStats stats() const {
+        return table_.stats();
+    }
+
     // Convenience wrapper for find().found().
     template <typename Lookup>
     bool has(const Lookup& key) {
@@ -145,11 +181,27 @@ class HashSet : private AllocPolicy
             table_.add(p, std::forward<UK>(key));
     }
 
+    // Add every key in a range, skipping keys that are already present. With
+    // forward iterators, this is faster than adding the keys one at a time,
+    // since the set is reserved once and lookups are batched and prefetched.
+    // Single-pass input iterators are read once, adding one key at a time.
+    template <typename Iter>
+    bool addAll(Iter begin, Iter end) {
+        typedef typename std::remove_reference<decltype(*begin)>::type Item;
+        return table_.addAll(begin, end,
+                             [](const Item& item) -> const Item& { return item; },
+                             [](const Item& item) -> const Item& { return item; });
+    }
+    template <typename Range>
+    bool addAll(const Range& range) {
+        return addAll(std::begin(range), std::end(range));
+    }
+
     AllocPolicy& allocPolicy() {
-        return *this;
+        return table_.allocPolicy();
     }
     const AllocPolicy& allocPolicy() const {
-        return *this;
+        return table_.allocPolicy();
     }
 
   private:
@@ -31,39 +31,196 @@
 #define _INCLUDE_KEIMA_HASHTABLE_H_
 
 #include <limits.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include <iterator>
 #include <new>
+#include <type_traits>
 #include <utility>
 
 #include "amtl/am-allocator-policies.h"
 #include "amtl/am-bits.h"
+#include "amtl/am-utility.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    define KE_HAVE_SSE2
+#    include <emmintrin.h>
+#endif
+#if defined(KE_CXX_MSVC) && defined(KE_ARCH_X64)
+#    include <intrin.h>
+#endif
 
 namespace ke {
 
+// Selects how a HashTable lays out its slots in memory.
+enum class HashStorage
+{
+    // Each slot holds its hash next to the payload. This is the default.
+    Inline,
+
+    // A separate array of one-byte control tags (7 hash bits, or a free or
+    // removed marker) is probed sixteen slots at a time. Payloads are only
+    // touched when a tag matches, so misses and collisions rarely leave the
+    // control array.
+    ControlBytes,
+
+    // Hashes are kept in one dense array and payloads in another, so probing
+    // only reads hashes, and small payloads are not padded out to the hash's
+    // alignment. Supports both HashDeletion modes.
+    Split
+};
+
+// Selects what happens to a slot when its entry is removed.
+enum class HashDeletion
+{
+    // The slot is marked as removed, so probes continue past it. Removed
+    // slots count toward the load factor until the table is rehashed. This
+    // is the default.
+    Tombstone,
+
+    // Later entries in the same probe cluster are shifted back to fill the
+    // hole, so no tombstones are ever created. This keeps probe chains short
+    // for tables with heavy insert/remove churn. Not available with
+    // HashStorage::ControlBytes.
+    BackwardShift
+};
+
+// Selects how insertion chooses a slot along the probe sequence.
+enum class HashProbing
+{
+    // An entry takes the first free or removed slot. This is the default.
+    Linear,
+
+    // An entry may displace entries that are closer to their home slot
+    // ("Robin Hood" hashing). Probe lengths have much lower variance, misses
+    // terminate early, and the table can be filled to 90% rather than 75%.
+    // Only available with HashStorage::Inline, and implies
+    // HashDeletion::BackwardShift.
+    RobinHood
+};
+
+// Selects how a HashTable moves its entries when it changes capacity.
+enum class HashResize
+{
+    // Every entry is moved to the new table at once. This is the default.
+    Immediate,
+
+    // The old table is kept alive alongside the new one, and a bounded
+    // number of its slots are migrated on each mutating operation. Lookups
+    // consult both tables until migration completes. This avoids a long
+    // stall when a very large table grows, at the cost of holding both
+    // tables in memory for a while.
+    Incremental
+};
+
+// Selects the width of hash codes, and of a HashTable's capacity and counts.
+enum class HashWidth
+{
+    // Hash codes are 32 bits, and a table can hold at most INT_MAX bytes of
+    // slots. This is the default.
+    Bits32,
+
+    // Hash codes are 64 bits, and a table is only limited by the address
+    // space. The policy's hash() functions should return uint64_t; a 32-bit
+    // hash works, but caps the number of distinct hash codes at 2^32. Slot
+    // indices come from the low bits, and HashStorage::ControlBytes tags from
+    // the top seven bits, so a full 64-bit hash keeps them independent.
+    Bits64
+};
+
+// Selects whether a HashTable counts its resizes, for HashTable::stats().
+enum class HashStats
+{
+    // Nothing is counted, and the counting code is compiled out. The rest of
+    // stats() still works, since it is computed by scanning the table. This
+    // is the default.
+    Disabled,
+
+    // The table counts how often it is rehashed and how many bytes of
+    // payload are moved when it is.
+    Enabled
+};
+
+// A snapshot of a HashTable's shape, from HashTable::stats().
+struct HashTableStats
+{
+    // probes[n] counts the entries that a lookup finds on its (n + 1)th
+    // probe. The last bucket also counts every longer probe sequence. With
+    // HashStorage::ControlBytes, a probe is one group of sixteen slots.
+    static const size_t kProbeBuckets = 16;
+
+    size_t capacity;
+    size_t elements;
+    size_t tombstones;
+    size_t probes[kProbeBuckets];
+    size_t maxProbeLength;
+    double averageProbeLength;
+
+    // The longest run of consecutive slots that are live or removed. Misses
+    // and insertions must scan to the end of a cluster.
+    size_t maxCluster;
+
+    // These are only counted with HashStats::Enabled, and are zero otherwise.
+    // They are never reset, even by clear().
+    uint64_t rehashes;
+    uint64_t bytesMoved;
+
+    HashTableStats()
+     : capacity(0),
+       elements(0),
+       tombstones(0),
+       probes(),
+       maxProbeLength(0),
+       averageProbeLength(0),
+       maxCluster(0),
+       rehashes(0),
+       bytesMoved(0)
+    {}
+
+    double tombstoneRatio() const {
+        return capacity ? double(tombstones) / double(capacity) : 0;
+    }
+};
+
 namespace detail {
-template <typename T>
+template <HashWidth Width>
+struct HashWidthTraits;
+
+template <>
+struct HashWidthTraits<HashWidth::Bits32> {
+    typedef uint32_t Hash;
+    static const uint32_t kGoldenRatio = 0x9E3779B9;
+    static const size_t kMaxTableBytes = INT_MAX;
+};
+
+template <>
+struct HashWidthTraits<HashWidth::Bits64> {
+    typedef uint64_t Hash;
+    static const uint64_t kGoldenRatio = 0x9E3779B97F4A7C15ull;
+    static const size_t kMaxTableBytes = SIZE_MAX / 2;
+};
+
+template <typename T, typename H>
 class HashTableEntry
 {
-    uint32_t hash_;
+    H hash_;
     T t_;
 
   public:
-    static const uint32_t kFreeHash = 0;
-    static const uint32_t kRemovedHash = 1;
+    static const H kFreeHash = 0;
+    static const H kRemovedHash = 1;
 
   public:
-    void setHash(uint32_t hash) {
+    void setHash(H hash) {
         hash_ = hash;
     }
-    void construct() {
-        new (&t_) T();
-    }
-    template <typename U>
-    void construct(U&& u) {
-        new (&t_) T(std::forward<U>(u));
+    template <typename... Args>
+    void construct(Args&&... args) {
+        new (&t_) T(std::forward<Args>(args)...);
     }
-    uint32_t hash() const {
+    H hash() const {
         return hash_;
     }
     void setRemoved() {
@@ -90,21 +247,1258 @@ class HashTableEntry
     bool isLive() const {
         return hash_ > kRemovedHash;
     }
-    T& payload() {
-        assert(isLive());
-        return t_;
+    T& payload() {
+        assert(isLive());
+        return t_;
+    }
+    const T& payload() const {
+        assert(isLive());
+        return t_;
+    }
+    bool sameHash(H hash) const {
+        return hash_ == hash;
+    }
+
+  private:
+    HashTableEntry(const HashTableEntry& other) = delete;
+    HashTableEntry& operator =(const HashTableEntry& other) = delete;
+};
+
+template <typename H>
+class Probulator
+{
+    H hash_;
+    H capacity_;
+
+  public:
+    Probulator(H hash, H capacity)
+     : hash_(hash),
+       capacity_(capacity)
+    {
+        assert(IsPowerOfTwo(capacity_));
+    }
+
+    H entry() const {
+        return hash_ & (capacity_ - 1);
+    }
+    H next() {
+        hash_++;
+        return entry();
+    }
+};
+
+// An array of HashTableEntry, probed one slot at a time. This holds the parts
+// shared by the inline storage classes below.
+template <typename T, typename H>
+class HashEntryArray
+{
+  protected:
+    typedef HashTableEntry<T, H> Entry;
+
+  public:
+    typedef H Hash;
+
+    static const size_t kSlotBytes = sizeof(Entry);
+    static const uint32_t kProbeWidth = 1;
+
+    HashEntryArray()
+     : table_(nullptr),
+       capacity_(0)
+    {}
+    HashEntryArray(HashEntryArray&& other)
+     : table_(other.table_),
+       capacity_(other.capacity_)
+    {
+        other.table_ = nullptr;
+        other.capacity_ = 0;
+    }
+    HashEntryArray& operator =(HashEntryArray&& other) {
+        assert(!table_);
+        table_ = other.table_;
+        capacity_ = other.capacity_;
+        other.table_ = nullptr;
+        other.capacity_ = 0;
+        return *this;
+    }
+
+    template <typename AllocPolicy>
+    bool allocate(AllocPolicy* ap, H capacity) {
+        Entry* table = (Entry*)AllocPolicyTraits<AllocPolicy>::allocate(
+            ap, capacity * sizeof(Entry), alignof(Entry));
+        if (!table)
+            return false;
+
+        for (size_t i = 0; i < capacity; i++)
+            table[i].initialize();
+
+        table_ = table;
+        capacity_ = capacity;
+        return true;
+    }
+
+    template <typename AllocPolicy>
+    void release(AllocPolicy* ap) {
+        for (H i = 0; i < capacity_; i++)
+            table_[i].destruct();
+        AllocPolicyTraits<AllocPolicy>::release(ap, table_, memoryUse(), alignof(Entry));
+        table_ = nullptr;
+        capacity_ = 0;
+    }
+
+    H capacity() const {
+        return capacity_;
+    }
+    size_t memoryUse() const {
+        return sizeof(Entry) * capacity_;
+    }
+
+    // Start loading the home slot for |hash| into the cache.
+    void prefetch(H hash) const {
+        KE_PREFETCH(&table_[hash & (capacity_ - 1)]);
+    }
+
+    void clear() {
+        for (size_t i = 0; i < capacity_; i++)
+            table_[i].setFree();
+    }
+
+  protected:
+    // Backward shifting only ever moves an entry toward the start of its
+    // cluster. Iterating from just past a free slot means no cluster wraps
+    // around the end of the iteration, so erasing the current entry can only
+    // move unvisited entries into the current slot.
+    H firstIndexAfterFree() const {
+        for (H i = 0; i < capacity_; i++) {
+            if (table_[i].isFree())
+                return (i + 1) & (capacity_ - 1);
+        }
+        return 0;
+    }
+
+    // Distance of the entry at |index| from its home slot.
+    H probeDistance(H index) const {
+        return (index - table_[index].hash()) & (capacity_ - 1);
+    }
+
+    // Free the slot at |hole|, then walk the rest of its cluster, moving back
+    // any entry whose home slot is not between the hole and its current slot.
+    void backwardShift(H hole) {
+        H mask = capacity_ - 1;
+
+        table_[hole].setFree();
+        for (H i = (hole + 1) & mask; !table_[i].isFree(); i = (i + 1) & mask) {
+            if (probeDistance(i) < ((i - hole) & mask))
+                continue;
+            moveEntry(hole, i);
+            hole = i;
+        }
+    }
+
+    void moveEntry(H to, H from) {
+        Entry& source = table_[from];
+        table_[to].setHash(source.hash());
+        table_[to].construct(std::move(source.payload()));
+        source.setFree();
+    }
+
+  private:
+    HashEntryArray(const HashEntryArray& other) = delete;
+    HashEntryArray& operator =(const HashEntryArray& other) = delete;
+
+  protected:
+    Entry* table_;
+    H capacity_;
+};
+
+// Slots are stored as an array of HashTableEntry, and probed one at a time.
+template <typename T, typename H, HashDeletion Deletion>
+class InlineHashStorage : public HashEntryArray<T, H>
+{
+    typedef HashEntryArray<T, H> Base;
+    typedef typename Base::Entry Entry;
+
+    using Base::table_;
+    using Base::capacity_;
+
+  public:
+    static const bool kLeavesTombstones = (Deletion == HashDeletion::Tombstone);
+    static const uint32_t kMaxLoadPercent = 75;
+
+    class Slot
+    {
+        friend class InlineHashStorage;
+
+        Entry* entry_;
+
+      public:
+        explicit Slot(Entry* entry)
+         : entry_(entry)
+        {}
+
+        bool isLive() const {
+            return entry_->isLive();
+        }
+        bool removed() const {
+            return entry_->removed();
+        }
+        H hash() const {
+            return entry_->hash();
+        }
+        T& payload() const {
+            return entry_->payload();
+        }
+    };
+
+    InlineHashStorage()
+    {}
+    InlineHashStorage(InlineHashStorage&& other)
+     : Base(std::move(other))
+    {}
+    InlineHashStorage& operator =(InlineHashStorage&& other) {
+        Base::operator =(std::move(other));
+        return *this;
+    }
+
+    Slot slotAt(H index) const {
+        return Slot(&table_[index]);
+    }
+    H iterationStart() const {
+        if (Deletion == HashDeletion::Tombstone)
+            return 0;
+        return this->firstIndexAfterFree();
+    }
+
+    template <typename HashPolicy, typename Key>
+    Slot lookup(const Key& key, H hash) const {
+        Probulator<H> probulator(hash, capacity_);
+
+        Entry* e = &table_[probulator.entry()];
+        for (;;) {
+            if (e->isFree())
+                break;
+            if (e->isLive() && e->sameHash(hash) && HashPolicy::matches(key, e->payload())) {
+                return Slot(e);
+            }
+            e = &table_[probulator.next()];
+        }
+
+        return Slot(e);
+    }
+
+    template <typename HashPolicy, typename Key>
+    Slot lookupForAdd(const Key& key, H hash) {
+        Probulator<H> probulator(hash, capacity_);
+
+        Entry* e = &table_[probulator.entry()];
+        Entry* firstRemoved = nullptr;
+        for (;;) {
+            if (e->isFree())
+                break;
+            if (e->removed()) {
+                if (!firstRemoved)
+                    firstRemoved = e;
+            } else if (e->sameHash(hash) && HashPolicy::matches(key, e->payload()))
+                break;
+            e = &table_[probulator.next()];
+        }
+
+        if (!e->isLive() && firstRemoved)
+            e = firstRemoved;
+
+        return Slot(e);
+    }
+
+    // For use when the key is known to be unique.
+    Slot insertUnique(H hash) {
+        Probulator<H> probulator(hash, capacity_);
+
+        Entry* e = &table_[probulator.entry()];
+        for (;;) {
+            if (e->isFree() || e->removed())
+                break;
+            e = &table_[probulator.next()];
+        }
+
+        return Slot(e);
+    }
+
+    void occupy(const Slot& slot, H hash) {
+        slot.entry_->setHash(hash);
+    }
+    template <typename... Args>
+    void construct(const Slot& slot, Args&&... args) {
+        slot.entry_->construct(std::forward<Args>(args)...);
+    }
+    void remove(const Slot& slot) {
+        if (Deletion == HashDeletion::Tombstone)
+            slot.entry_->setRemoved();
+        else
+            this->backwardShift(H(slot.entry_ - table_));
+    }
+
+    // The following are used while this storage is being drained by an
+    // incremental resize. Entries are evicted by leaving a tombstone, even if
+    // the storage does not normally use them, so that probe chains for the
+    // entries not yet migrated stay intact.
+    void evict(const Slot& slot) {
+        slot.entry_->setRemoved();
+    }
+    template <typename HashPolicy, typename Key>
+    Slot lookupDraining(const Key& key, H hash) const {
+        return lookup<HashPolicy>(key, hash);
+    }
+    bool owns(const Slot& slot) const {
+        return slot.entry_ >= table_ && slot.entry_ < table_ + capacity_;
+    }
+};
+
+// Robin Hood hashing: an entry being inserted takes the slot of any entry
+// that is closer to its own home slot, and the rest of the cluster moves up
+// by one. This keeps each cluster sorted by home slot, which bounds the
+// variance of probe lengths and lets an unsuccessful lookup stop as soon as
+// it passes the point where its key would have been placed.
+//
+// The probe distance of an entry is derived from its stored hash, so it
+// takes no extra space. Removal always uses backward shifting.
+template <typename T, typename H>
+class RobinHoodHashStorage : public HashEntryArray<T, H>
+{
+    typedef HashEntryArray<T, H> Base;
+    typedef typename Base::Entry Entry;
+
+    using Base::table_;
+    using Base::capacity_;
+
+  public:
+    static const bool kLeavesTombstones = false;
+    static const uint32_t kMaxLoadPercent = 90;
+
+    // A slot found by a lookup may hold a different entry that the new key
+    // will displace, so liveness is tracked separately from the entry.
+    class Slot
+    {
+        friend class RobinHoodHashStorage;
+
+        Entry* entry_;
+        bool live_;
+
+      public:
+        Slot(Entry* entry, bool live)
+         : entry_(entry),
+           live_(live)
+        {}
+
+        bool isLive() const {
+            return live_;
+        }
+        bool removed() const {
+            return false;
+        }
+        H hash() const {
+            return entry_->hash();
+        }
+        T& payload() const {
+            assert(live_);
+            return entry_->payload();
+        }
+    };
+
+    RobinHoodHashStorage()
+    {}
+    RobinHoodHashStorage(RobinHoodHashStorage&& other)
+     : Base(std::move(other))
+    {}
+    RobinHoodHashStorage& operator =(RobinHoodHashStorage&& other) {
+        Base::operator =(std::move(other));
+        return *this;
+    }
+
+    Slot slotAt(H index) const {
+        return Slot(&table_[index], table_[index].isLive());
+    }
+    H iterationStart() const {
+        return this->firstIndexAfterFree();
+    }
+
+    template <typename HashPolicy, typename Key>
+    Slot lookup(const Key& key, H hash) const {
+        H mask = capacity_ - 1;
+        H index = hash & mask;
+        for (H distance = 0;; distance++) {
+            Entry* e = &table_[index];
+            if (e->isFree() || this->probeDistance(index) < distance)
+                return Slot(e, false);
+            if (e->sameHash(hash) && HashPolicy::matches(key, e->payload()))
+                return Slot(e, true);
+            index = (index + 1) & mask;
+        }
+    }
+
+    template <typename HashPolicy, typename Key>
+    Slot lookupForAdd(const Key& key, H hash) {
+        return lookup<HashPolicy>(key, hash);
+    }
+
+    // For use when the key is known to be unique.
+    Slot insertUnique(H hash) {
+        H mask = capacity_ - 1;
+        H index = hash & mask;
+        for (H distance = 0;; distance++) {
+            Entry* e = &table_[index];
+            if (e->isFree() || this->probeDistance(index) < distance)
+                return Slot(e, false);
+            index = (index + 1) & mask;
+        }
+    }
+
+    void occupy(Slot& slot, H hash) {
+        H index = H(slot.entry_ - table_);
+        if (slot.entry_->isLive())
+            displace(index);
+        slot.entry_->setHash(hash);
+        slot.live_ = true;
+    }
+    template <typename... Args>
+    void construct(const Slot& slot, Args&&... args) {
+        slot.entry_->construct(std::forward<Args>(args)...);
+    }
+    void remove(const Slot& slot) {
+        assert(slot.live_);
+        this->backwardShift(H(slot.entry_ - table_));
+    }
+
+    // See InlineHashStorage. Tombstones break the ordering that lets Robin
+    // Hood lookups stop early, so lookups in a draining table probe all the
+    // way to a free slot.
+    void evict(const Slot& slot) {
+        assert(slot.live_);
+        slot.entry_->setRemoved();
+    }
+    template <typename HashPolicy, typename Key>
+    Slot lookupDraining(const Key& key, H hash) const {
+        Probulator<H> probulator(hash, capacity_);
+
+        Entry* e = &table_[probulator.entry()];
+        for (;;) {
+            if (e->isFree())
+                return Slot(e, false);
+            if (e->isLive() && e->sameHash(hash) && HashPolicy::matches(key, e->payload()))
+                return Slot(e, true);
+            e = &table_[probulator.next()];
+        }
+    }
+    bool owns(const Slot& slot) const {
+        return slot.entry_ >= table_ && slot.entry_ < table_ + capacity_;
+    }
+
+  private:
+    // Move the cluster starting at |index| up by one slot, freeing |index|.
+    // Every moved entry lands one further from its home, which keeps the
+    // cluster sorted by home slot.
+    void displace(H index) {
+        H mask = capacity_ - 1;
+        H end = index;
+        while (!table_[end].isFree())
+            end = (end + 1) & mask;
+        while (end != index) {
+            H prev = (end - 1) & mask;
+            this->moveEntry(end, prev);
+            end = prev;
+        }
+    }
+};
+
+// A window of control bytes that can be tested against a tag all at once.
+class HashControlGroup
+{
+  public:
+    static const uint32_t kWidth = 16;
+
+    // Full slots hold a 7-bit tag, so the high bit distinguishes them from
+    // free and removed slots.
+    static const uint8_t kEmpty = 0x80;
+    static const uint8_t kDeleted = 0xfe;
+
+    explicit HashControlGroup(const uint8_t* ctrl)
+#if defined(KE_HAVE_SSE2)
+     : ctrl_(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl)))
+#else
+     : ctrl_(ctrl)
+#endif
+    {}
+
+    // Returns a bitmask of the slots in this group whose byte is |tag|.
+    uint32_t match(uint8_t tag) const {
+#if defined(KE_HAVE_SSE2)
+        __m128i cmp = _mm_cmpeq_epi8(ctrl_, _mm_set1_epi8(static_cast<char>(tag)));
+        return static_cast<uint32_t>(_mm_movemask_epi8(cmp));
+#else
+        uint32_t mask = 0;
+        for (uint32_t i = 0; i < kWidth; i++) {
+            if (ctrl_[i] == tag)
+                mask |= uint32_t(1) << i;
+        }
+        return mask;
+#endif
+    }
+    uint32_t matchEmpty() const {
+        return match(kEmpty);
+    }
+    uint32_t matchEmptyOrDeleted() const {
+#if defined(KE_HAVE_SSE2)
+        return static_cast<uint32_t>(_mm_movemask_epi8(ctrl_));
+#else
+        uint32_t mask = 0;
+        for (uint32_t i = 0; i < kWidth; i++) {
+            if (ctrl_[i] & 0x80)
+                mask |= uint32_t(1) << i;
+        }
+        return mask;
+#endif
+    }
+
+  private:
+#if defined(KE_HAVE_SSE2)
+    __m128i ctrl_;
+#else
+    const uint8_t* ctrl_;
+#endif
+};
+
+// Slots are stored as an array of HashTableEntry, fronted by an array of
+// control bytes which is probed a HashControlGroup at a time. The control
+// array has kWidth trailing bytes mirroring the first kWidth slots, so that a
+// group starting near the end of the table does not need to wrap.
+template <typename T, typename H>
+class ControlHashStorage
+{
+    typedef HashTableEntry<T, H> Entry;
+    typedef HashControlGroup Group;
+
+  public:
+    typedef H Hash;
+
+    static const size_t kSlotBytes = sizeof(Entry) + 1;
+    static const uint32_t kProbeWidth = Group::kWidth;
+    static const bool kLeavesTombstones = true;
+    static const uint32_t kMaxLoadPercent = 75;
+
+    class Slot
+    {
+        friend class ControlHashStorage;
+
+        uint8_t* ctrl_;
+        Entry* entry_;
+
+      public:
+        Slot(uint8_t* ctrl, Entry* entry)
+         : ctrl_(ctrl),
+           entry_(entry)
+        {}
+
+        bool isLive() const {
+            return !(*ctrl_ & 0x80);
+        }
+        bool removed() const {
+            return *ctrl_ == Group::kDeleted;
+        }
+        H hash() const {
+            return entry_->hash();
+        }
+        T& payload() const {
+            return entry_->payload();
+        }
+    };
+
+    ControlHashStorage()
+     : entries_(nullptr),
+       ctrl_(nullptr),
+       capacity_(0)
+    {}
+    ControlHashStorage(ControlHashStorage&& other)
+     : entries_(other.entries_),
+       ctrl_(other.ctrl_),
+       capacity_(other.capacity_)
+    {
+        other.entries_ = nullptr;
+        other.ctrl_ = nullptr;
+        other.capacity_ = 0;
+    }
+    ControlHashStorage& operator =(ControlHashStorage&& other) {
+        assert(!entries_);
+        entries_ = other.entries_;
+        ctrl_ = other.ctrl_;
+        capacity_ = other.capacity_;
+        other.entries_ = nullptr;
+        other.ctrl_ = nullptr;
+        other.capacity_ = 0;
+        return *this;
+    }
+
+    template <typename AllocPolicy>
+    bool allocate(AllocPolicy* ap, H capacity) {
+        assert(capacity >= Group::kWidth);
+
+        // The control bytes live directly after the entries, so that one
+        // allocation covers both.
+        size_t bytes = capacity * sizeof(Entry) + capacity + Group::kWidth;
+        Entry* entries = (Entry*)AllocPolicyTraits<AllocPolicy>::allocate(ap, bytes, alignof(Entry));
+        if (!entries)
+            return false;
+
+        for (size_t i = 0; i < capacity; i++)
+            entries[i].initialize();
+
+        entries_ = entries;
+        ctrl_ = reinterpret_cast<uint8_t*>(entries + capacity);
+        capacity_ = capacity;
+        memset(ctrl_, Group::kEmpty, capacity + Group::kWidth);
+        return true;
+    }
+
+    template <typename AllocPolicy>
+    void release(AllocPolicy* ap) {
+        for (H i = 0; i < capacity_; i++)
+            entries_[i].destruct();
+        AllocPolicyTraits<AllocPolicy>::release(ap, entries_, memoryUse(), alignof(Entry));
+        entries_ = nullptr;
+        ctrl_ = nullptr;
+        capacity_ = 0;
+    }
+
+    H capacity() const {
+        return capacity_;
+    }
+    size_t memoryUse() const {
+        if (!capacity_)
+            return 0;
+        return (sizeof(Entry) + 1) * capacity_ + Group::kWidth;
+    }
+    Slot slotAt(H index) const {
+        return Slot(&ctrl_[index], &entries_[index]);
+    }
+    void prefetch(H hash) const {
+        H pos = hash & (capacity_ - 1);
+        KE_PREFETCH(&ctrl_[pos]);
+        KE_PREFETCH(&entries_[pos]);
+    }
+    H iterationStart() const {
+        return 0;
+    }
+
+    template <typename HashPolicy, typename Key>
+    Slot lookup(const Key& key, H hash) const {
+        uint8_t tag = tagOf(hash);
+        H mask = capacity_ - 1;
+        H pos = hash & mask;
+        for (;;) {
+            Group group(&ctrl_[pos]);
+            for (uint32_t bits = group.match(tag); bits; bits &= bits - 1) {
+                H index = (pos + FindRightmostBit(bits)) & mask;
+                Entry& e = entries_[index];
+                if (e.sameHash(hash) && HashPolicy::matches(key, e.payload()))
+                    return slotAt(index);
+            }
+            if (uint32_t empty = group.matchEmpty())
+                return slotAt((pos + FindRightmostBit(empty)) & mask);
+            pos = (pos + Group::kWidth) & mask;
+        }
+    }
+
+    template <typename HashPolicy, typename Key>
+    Slot lookupForAdd(const Key& key, H hash) {
+        uint8_t tag = tagOf(hash);
+        H mask = capacity_ - 1;
+        H pos = hash & mask;
+        H target = 0;
+        bool haveTarget = false;
+        for (;;) {
+            Group group(&ctrl_[pos]);
+            for (uint32_t bits = group.match(tag); bits; bits &= bits - 1) {
+                H index = (pos + FindRightmostBit(bits)) & mask;
+                Entry& e = entries_[index];
+                if (e.sameHash(hash) && HashPolicy::matches(key, e.payload()))
+                    return slotAt(index);
+            }
+            if (!haveTarget) {
+                if (uint32_t avail = group.matchEmptyOrDeleted()) {
+                    target = (pos + FindRightmostBit(avail)) & mask;
+                    haveTarget = true;
+                }
+            }
+            if (group.matchEmpty())
+                break;
+            pos = (pos + Group::kWidth) & mask;
+        }
+
+        assert(haveTarget);
+        return slotAt(target);
+    }
+
+    // For use when the key is known to be unique.
+    Slot insertUnique(H hash) {
+        H mask = capacity_ - 1;
+        H pos = hash & mask;
+        for (;;) {
+            Group group(&ctrl_[pos]);
+            if (uint32_t avail = group.matchEmptyOrDeleted())
+                return slotAt((pos + FindRightmostBit(avail)) & mask);
+            pos = (pos + Group::kWidth) & mask;
+        }
+    }
+
+    void occupy(const Slot& slot, H hash) {
+        slot.entry_->setHash(hash);
+        setCtrl(indexOf(slot), tagOf(hash));
+    }
+    template <typename... Args>
+    void construct(const Slot& slot, Args&&... args) {
+        slot.entry_->construct(std::forward<Args>(args)...);
+    }
+    void remove(const Slot& slot) {
+        slot.entry_->setRemoved();
+        setCtrl(indexOf(slot), Group::kDeleted);
+    }
+
+    // See InlineHashStorage.
+    void evict(const Slot& slot) {
+        remove(slot);
+    }
+    template <typename HashPolicy, typename Key>
+    Slot lookupDraining(const Key& key, H hash) const {
+        return lookup<HashPolicy>(key, hash);
+    }
+    bool owns(const Slot& slot) const {
+        return slot.ctrl_ >= ctrl_ && slot.ctrl_ < ctrl_ + capacity_;
+    }
+
+    void clear() {
+        for (size_t i = 0; i < capacity_; i++)
+            entries_[i].setFree();
+        if (ctrl_)
+            memset(ctrl_, Group::kEmpty, capacity_ + Group::kWidth);
+    }
+
+  private:
+    // The low bits of the hash pick the starting slot, so the tag is taken
+    // from the high bits.
+    static uint8_t tagOf(H hash) {
+        return uint8_t(hash >> (sizeof(H) * 8 - 7));
+    }
+    H indexOf(const Slot& slot) const {
+        return H(slot.ctrl_ - ctrl_);
+    }
+    void setCtrl(H index, uint8_t value) {
+        ctrl_[index] = value;
+        if (index < Group::kWidth)
+            ctrl_[capacity_ + index] = value;
+    }
+
+  private:
+    ControlHashStorage(const ControlHashStorage& other) = delete;
+    ControlHashStorage& operator =(const ControlHashStorage& other) = delete;
+
+  private:
+    Entry* entries_;
+    uint8_t* ctrl_;
+    H capacity_;
+};
+
+// Hashes and payloads are stored in two parallel arrays, in one allocation.
+// Probing scans only the dense hash array, and payloads need no padding for
+// the hash's alignment.
+template <typename T, typename H, HashDeletion Deletion>
+class SplitHashStorage
+{
+    static const H kFreeHash = 0;
+    static const H kRemovedHash = 1;
+
+    // The allocation must suit both arrays.
+    static const size_t kAlignment = alignof(T) > alignof(H) ? alignof(T) : alignof(H);
+
+  public:
+    typedef H Hash;
+
+    static const size_t kSlotBytes = sizeof(H) + sizeof(T);
+    static const uint32_t kProbeWidth = 1;
+    static const bool kLeavesTombstones = (Deletion == HashDeletion::Tombstone);
+    static const uint32_t kMaxLoadPercent = 75;
+
+    class Slot
+    {
+        friend class SplitHashStorage;
+
+        H* hash_;
+        T* payload_;
+
+      public:
+        Slot(H* hash, T* payload)
+         : hash_(hash),
+           payload_(payload)
+        {}
+
+        bool isLive() const {
+            return *hash_ > kRemovedHash;
+        }
+        bool removed() const {
+            return *hash_ == kRemovedHash;
+        }
+        H hash() const {
+            return *hash_;
+        }
+        T& payload() const {
+            assert(isLive());
+            return *payload_;
+        }
+    };
+
+    SplitHashStorage()
+     : hashes_(nullptr),
+       payloads_(nullptr),
+       capacity_(0)
+    {}
+    SplitHashStorage(SplitHashStorage&& other)
+     : hashes_(other.hashes_),
+       payloads_(other.payloads_),
+       capacity_(other.capacity_)
+    {
+        other.hashes_ = nullptr;
+        other.payloads_ = nullptr;
+        other.capacity_ = 0;
+    }
+    SplitHashStorage& operator =(SplitHashStorage&& other) {
+        assert(!hashes_);
+        hashes_ = other.hashes_;
+        payloads_ = other.payloads_;
+        capacity_ = other.capacity_;
+        other.hashes_ = nullptr;
+        other.payloads_ = nullptr;
+        other.capacity_ = 0;
+        return *this;
+    }
+
+    template <typename AllocPolicy>
+    bool allocate(AllocPolicy* ap, H capacity) {
+        // The payloads live directly after the hashes, so that one
+        // allocation covers both.
+        size_t offset = payloadOffset(capacity);
+        char* base = (char*)AllocPolicyTraits<AllocPolicy>::allocate(
+            ap, offset + capacity * sizeof(T), kAlignment);
+        if (!base)
+            return false;
+
+        hashes_ = reinterpret_cast<H*>(base);
+        payloads_ = reinterpret_cast<T*>(base + offset);
+        capacity_ = capacity;
+        memset(hashes_, 0, capacity * sizeof(H));
+        return true;
+    }
+
+    template <typename AllocPolicy>
+    void release(AllocPolicy* ap) {
+        destructAll();
+        AllocPolicyTraits<AllocPolicy>::release(ap, hashes_, memoryUse(), kAlignment);
+        hashes_ = nullptr;
+        payloads_ = nullptr;
+        capacity_ = 0;
+    }
+
+    H capacity() const {
+        return capacity_;
+    }
+    size_t memoryUse() const {
+        if (!capacity_)
+            return 0;
+        return payloadOffset(capacity_) + capacity_ * sizeof(T);
+    }
+    Slot slotAt(H index) const {
+        return Slot(&hashes_[index], &payloads_[index]);
+    }
+    void prefetch(H hash) const {
+        H pos = hash & (capacity_ - 1);
+        KE_PREFETCH(&hashes_[pos]);
+        KE_PREFETCH(&payloads_[pos]);
+    }
+    H iterationStart() const {
+        if (Deletion == HashDeletion::Tombstone)
+            return 0;
+
+        // See HashEntryArray::firstIndexAfterFree().
+        for (H i = 0; i < capacity_; i++) {
+            if (hashes_[i] == kFreeHash)
+                return (i + 1) & (capacity_ - 1);
+        }
+        return 0;
+    }
+
+    template <typename HashPolicy, typename Key>
+    Slot lookup(const Key& key, H hash) const {
+        Probulator<H> probulator(hash, capacity_);
+
+        H index = probulator.entry();
+        for (;;) {
+            H current = hashes_[index];
+            if (current == kFreeHash)
+                break;
+            if (current == hash && HashPolicy::matches(key, payloads_[index]))
+                break;
+            index = probulator.next();
+        }
+        return slotAt(index);
+    }
+
+    template <typename HashPolicy, typename Key>
+    Slot lookupForAdd(const Key& key, H hash) {
+        Probulator<H> probulator(hash, capacity_);
+
+        H index = probulator.entry();
+        H firstRemoved = capacity_;
+        for (;;) {
+            H current = hashes_[index];
+            if (current == kFreeHash)
+                break;
+            if (current == kRemovedHash) {
+                if (firstRemoved == capacity_)
+                    firstRemoved = index;
+            } else if (current == hash && HashPolicy::matches(key, payloads_[index])) {
+                return slotAt(index);
+            }
+            index = probulator.next();
+        }
+
+        if (firstRemoved != capacity_)
+            index = firstRemoved;
+        return slotAt(index);
+    }
+
+    // For use when the key is known to be unique.
+    Slot insertUnique(H hash) {
+        Probulator<H> probulator(hash, capacity_);
+
+        H index = probulator.entry();
+        while (hashes_[index] > kRemovedHash)
+            index = probulator.next();
+        return slotAt(index);
+    }
+
+    void occupy(const Slot& slot, H hash) {
+        *slot.hash_ = hash;
+    }
+    template <typename... Args>
+    void construct(const Slot& slot, Args&&... args) {
+        new (slot.payload_) T(std::forward<Args>(args)...);
+    }
+    void remove(const Slot& slot) {
+        if (Deletion == HashDeletion::Tombstone)
+            evict(slot);
+        else
+            backwardShift(indexOf(slot));
+    }
+
+    // See InlineHashStorage.
+    void evict(const Slot& slot) {
+        slot.payload_->~T();
+        *slot.hash_ = kRemovedHash;
+    }
+    template <typename HashPolicy, typename Key>
+    Slot lookupDraining(const Key& key, H hash) const {
+        return lookup<HashPolicy>(key, hash);
+    }
+    bool owns(const Slot& slot) const {
+        return slot.hash_ >= hashes_ && slot.hash_ < hashes_ + capacity_;
+    }
+
+    void clear() {
+        destructAll();
+        if (hashes_)
+            memset(hashes_, 0, capacity_ * sizeof(H));
+    }
+
+  private:
+    static size_t payloadOffset(H capacity) {
+        return Align(capacity * sizeof(H), alignof(T));
+    }
+    H indexOf(const Slot& slot) const {
+        return H(slot.hash_ - hashes_);
+    }
+    void destructAll() {
+        for (H i = 0; i < capacity_; i++) {
+            if (hashes_[i] > kRemovedHash)
+                payloads_[i].~T();
+        }
+    }
+
+    // See HashEntryArray::backwardShift().
+    void backwardShift(H hole) {
+        H mask = capacity_ - 1;
+
+        payloads_[hole].~T();
+        hashes_[hole] = kFreeHash;
+        for (H i = (hole + 1) & mask; hashes_[i] != kFreeHash; i = (i + 1) & mask) {
+            if (((i - hashes_[i]) & mask) < ((i - hole) & mask))
+                continue;
+            hashes_[hole] = hashes_[i];
+            new (&payloads_[hole]) T(std::move(payloads_[i]));
+            payloads_[i].~T();
+            hashes_[i] = kFreeHash;
+            hole = i;
+        }
+    }
+
+  private:
+    SplitHashStorage(const SplitHashStorage& other) = delete;
+    SplitHashStorage& operator =(const SplitHashStorage& other) = delete;
+
+  private:
+    H* hashes_;
+    T* payloads_;
+    H capacity_;
+};
+
+template <typename T, typename Options, HashStorage Storage = Options::kStorage>
+struct SelectHashStorage;
+
+template <typename T, typename Options>
+struct SelectHashStorage<T, Options, HashStorage::Inline> {
+    typedef typename HashWidthTraits<Options::kWidth>::Hash Hash;
+    typedef typename std::conditional<Options::kProbing == HashProbing::RobinHood,
+                                      RobinHoodHashStorage<T, Hash>,
+                                      InlineHashStorage<T, Hash, Options::kDeletion>>::type type;
+};
+
+template <typename T, typename Options>
+struct SelectHashStorage<T, Options, HashStorage::ControlBytes> {
+    static_assert(Options::kDeletion == HashDeletion::Tombstone,
+                  "HashStorage::ControlBytes only supports HashDeletion::Tombstone");
+    static_assert(Options::kProbing == HashProbing::Linear,
+                  "HashStorage::ControlBytes only supports HashProbing::Linear");
+    typedef ControlHashStorage<T, typename HashWidthTraits<Options::kWidth>::Hash> type;
+};
+
+template <typename T, typename Options>
+struct SelectHashStorage<T, Options, HashStorage::Split> {
+    static_assert(Options::kProbing == HashProbing::Linear,
+                  "HashStorage::Split only supports HashProbing::Linear");
+    typedef SplitHashStorage<T, typename HashWidthTraits<Options::kWidth>::Hash,
+                             Options::kDeletion> type;
+};
+
+template <typename T>
+struct HashPolicyVoid {
+    typedef void type;
+};
+
+template <typename Policy, typename = void>
+struct HashPolicyStorage {
+    static const HashStorage value = HashStorage::Inline;
+};
+
+template <typename Policy>
+struct HashPolicyStorage<Policy, typename HashPolicyVoid<decltype(Policy::kStorage)>::type> {
+    static const HashStorage value = Policy::kStorage;
+};
+
+template <typename Policy, typename = void>
+struct HashPolicyDeletion {
+    static const HashDeletion value = HashDeletion::Tombstone;
+};
+
+template <typename Policy>
+struct HashPolicyDeletion<Policy, typename HashPolicyVoid<decltype(Policy::kDeletion)>::type> {
+    static const HashDeletion value = Policy::kDeletion;
+};
+
+template <typename Policy, typename = void>
+struct HashPolicyProbing {
+    static const HashProbing value = HashProbing::Linear;
+};
+
+template <typename Policy>
+struct HashPolicyProbing<Policy, typename HashPolicyVoid<decltype(Policy::kProbing)>::type> {
+    static const HashProbing value = Policy::kProbing;
+};
+
+template <typename Policy, typename = void>
+struct HashPolicyResize {
+    static const HashResize value = HashResize::Immediate;
+};
+
+template <typename Policy>
+struct HashPolicyResize<Policy, typename HashPolicyVoid<decltype(Policy::kResize)>::type> {
+    static const HashResize value = Policy::kResize;
+};
+
+template <typename Policy, typename = void>
+struct HashPolicyWidth {
+    static const HashWidth value = HashWidth::Bits32;
+};
+
+template <typename Policy>
+struct HashPolicyWidth<Policy, typename HashPolicyVoid<decltype(Policy::kWidth)>::type> {
+    static const HashWidth value = Policy::kWidth;
+};
+
+template <typename Policy, typename = void>
+struct HashPolicyRehashThreads {
+    static const uint32_t value = 1;
+};
+
+template <typename Policy>
+struct HashPolicyRehashThreads<Policy, typename HashPolicyVoid<decltype(Policy::kRehashThreads)>::type> {
+    static const uint32_t value = Policy::kRehashThreads;
+};
+
+// Runs the workers of a parallel rehash one after another, on the calling
+// thread. See RehashThreads in am-rehash-threads.h for one that uses threads.
+struct SerialRehashWorkers {
+    template <typename Fn>
+    static void run(uint32_t count, Fn& fn) {
+        for (uint32_t i = 0; i < count; i++)
+            fn(i);
+    }
+};
+
+template <typename Policy, typename = void>
+struct HashPolicyRehashWorkers {
+    typedef SerialRehashWorkers type;
+};
+
+template <typename Policy>
+struct HashPolicyRehashWorkers<Policy,
+                               typename HashPolicyVoid<typename Policy::RehashWorkers>::type> {
+    typedef typename Policy::RehashWorkers type;
+};
+
+template <typename Policy, typename = void>
+struct HashPolicyStats {
+    static const HashStats value = HashStats::Disabled;
+};
+
+template <typename Policy>
+struct HashPolicyStats<Policy, typename HashPolicyVoid<decltype(Policy::kStats)>::type> {
+    static const HashStats value = Policy::kStats;
+};
+
+// Collects the optional members of a HashPolicy, filling in defaults for
+// those that are missing. Wrapper policies (like the ones in HashMap and
+// HashSet) can inherit from this to forward the options of a user policy.
+template <typename Policy>
+struct HashPolicyOptions {
+    static const HashStorage kStorage = HashPolicyStorage<Policy>::value;
+    static const HashDeletion kDeletion = HashPolicyDeletion<Policy>::value;
+    static const HashProbing kProbing = HashPolicyProbing<Policy>::value;
+    static const HashResize kResize = HashPolicyResize<Policy>::value;
+    static const HashWidth kWidth = HashPolicyWidth<Policy>::value;
+    static const HashStats kStats = HashPolicyStats<Policy>::value;
+    static const uint32_t kRehashThreads = HashPolicyRehashThreads<Policy>::value;
+    typedef typename HashPolicyRehashWorkers<Policy>::type RehashWorkers;
+};
+
+// State for an incremental resize in progress: the old table, which is being
+// drained, and the index of the next slot in it to migrate.
+template <typename Storage, bool Enabled>
+class HashMigration
+{
+    typedef typename Storage::Hash Hash;
+
+  public:
+    HashMigration()
+     : cursor_(0)
+    {}
+    HashMigration(HashMigration&& other)
+     : table_(std::move(other.table_)),
+       cursor_(other.cursor_)
+    {
+        other.cursor_ = 0;
+    }
+
+    bool active() const {
+        return table_.capacity() != 0;
+    }
+    Storage* table() {
+        return &table_;
+    }
+    const Storage* table() const {
+        return &table_;
+    }
+    Hash cursor() const {
+        return cursor_;
+    }
+    void setCursor(Hash cursor) {
+        cursor_ = cursor;
+    }
+
+  private:
+    Storage table_;
+    Hash cursor_;
+};
+
+// When incremental resizing is disabled, a migration is never active, and
+// the code using it folds away.
+template <typename Storage>
+class HashMigration<Storage, false>
+{
+    typedef typename Storage::Hash Hash;
+
+  public:
+    bool active() const {
+        return false;
+    }
+    Storage* table() {
+        return nullptr;
+    }
+    const Storage* table() const {
+        return nullptr;
+    }
+    Hash cursor() const {
+        return 0;
+    }
+    void setCursor(Hash cursor) {
+    }
+};
+
+// Resize counters for HashStats::Enabled.
+template <bool Enabled>
+class HashCounters
+{
+  public:
+    HashCounters()
+     : rehashes_(0),
+       bytesMoved_(0)
+    {}
+
+    void onRehash() {
+        rehashes_++;
+    }
+    void onMove(size_t bytes) {
+        bytesMoved_ += bytes;
     }
-    const T& payload() const {
-        assert(isLive());
-        return t_;
+    uint64_t rehashes() const {
+        return rehashes_;
     }
-    bool sameHash(uint32_t hash) const {
-        return hash_ == hash;
+    uint64_t bytesMoved() const {
+        return bytesMoved_;
     }
 
   private:
-    HashTableEntry(const HashTableEntry& other) = delete;
-    HashTableEntry& operator =(const HashTableEntry& other) = delete;
+    uint64_t rehashes_;
+    uint64_t bytesMoved_;
+};
+
+template <>
+class HashCounters<false>
+{
+  public:
+    void onRehash() {
+    }
+    void onMove(size_t bytes) {
+    }
+    uint64_t rehashes() const {
+        return 0;
+    }
+    uint64_t bytesMoved() const {
+        return 0;
+    }
 };
 } // namespace detail
 
@@ -127,6 +1521,52 @@ class HashTableEntry
 //       }
 //     };
 //
+// The policy may also have the following optional members:
+//
+//     static const HashStorage kStorage;
+//         How slots are laid out in memory. The default is
+//         HashStorage::Inline.
+//
+//     static const HashDeletion kDeletion;
+//         How removed entries are handled. The default is
+//         HashDeletion::Tombstone.
+//
+//     static const HashProbing kProbing;
+//         How insertion picks a slot. The default is HashProbing::Linear.
+//
+//     static const HashResize kResize;
+//         How entries move when the table changes capacity. The default is
+//         HashResize::Immediate.
+//
+//     static const HashWidth kWidth;
+//         The width of hash codes and sizes. The default is
+//         HashWidth::Bits32. With HashWidth::Bits64, hash() should return
+//         uint64_t.
+//
+//     static const HashStats kStats;
+//         Whether resizes are counted for stats(). The default is
+//         HashStats::Disabled.
+//
+//     static const uint32_t kRehashThreads;
+//         The number of threads, including the calling thread, that move
+//         entries when a large table is resized. The parallel resize does
+//         more work in total, so this should not exceed the number of idle
+//         cores. The default is 1. Only available with HashStorage::Inline
+//         or HashStorage::Split, HashProbing::Linear, and
+//         HashResize::Immediate, and requires RehashWorkers.
+//
+//     typedef ... RehashWorkers;
+//         Runs the workers of a parallel resize. It must have a static
+//         function
+//
+//             template <typename Fn>
+//             static void run(uint32_t count, Fn& fn);
+//
+//         that calls fn(0) through fn(count - 1), possibly concurrently, and
+//         returns once they all have. It cannot fail: work it cannot hand to
+//         another thread must run on the calling thread. RehashThreads, from
+//         am-rehash-threads.h, starts a thread per worker.
+//
 // Note that the table is not usable until init() has been called.
 //
 template <typename HashPolicy, typename AllocPolicy = SystemAllocatorPolicy>
@@ -135,107 +1575,119 @@ class HashTable : private AllocPolicy
     friend class iterator;
 
     typedef typename HashPolicy::Payload Payload;
-    typedef detail::HashTableEntry<Payload> Entry;
+    typedef detail::HashPolicyOptions<HashPolicy> Options;
+    typedef typename detail::SelectHashStorage<Payload, Options>::type Storage;
+    typedef typename Storage::Slot Slot;
+    typedef detail::HashMigration<Storage, Options::kResize == HashResize::Incremental>
+        Migration;
+    typedef detail::HashWidthTraits<Options::kWidth> Width;
+    typedef detail::HashCounters<Options::kStats == HashStats::Enabled> Counters;
+
+  public:
+    // The type of hash codes, and of the table's sizes (see HashWidth).
+    typedef typename Width::Hash HashCode;
 
   private:
-    static const uint32_t kMinCapacity = 16;
-    static const uint32_t kMaxCapacity = INT_MAX / sizeof(Entry);
+    static const HashCode kMinCapacity = 16;
+    static const HashCode kMaxCapacity = Width::kMaxTableBytes / Storage::kSlotBytes;
+
+    // The number of old-table slots an incremental resize migrates on each
+    // mutating operation. Any value of at least one finishes the migration
+    // before the new table can need to resize again.
+    static const HashCode kMigrationStep = 64;
+
+    // Resizes of tables with fewer entries than this are never parallel,
+    // since starting threads would cost more than it saves.
+    static const size_t kParallelRehashMinimum = 1 << 16;
+    static const uint32_t kRehashThreads = Options::kRehashThreads;
+
+    static_assert(kRehashThreads >= 1 && kRehashThreads <= 64,
+                  "kRehashThreads must be between 1 and 64");
+    static_assert(kRehashThreads == 1 ||
+                  !std::is_same<typename Options::RehashWorkers,
+                                detail::SerialRehashWorkers>::value,
+                  "kRehashThreads needs RehashWorkers, such as RehashThreads from "
+                  "am-rehash-threads.h");
+    static_assert(kRehashThreads == 1 ||
+                  (Storage::kProbeWidth == 1 && Options::kProbing == HashProbing::Linear &&
+                   Options::kResize == HashResize::Immediate),
+                  "Parallel rehashing needs linear probing, one slot at a time, and "
+                  "immediate resizing");
 
     template <typename Key>
-    uint32_t computeHash(const Key& key) const {
+    HashCode computeHash(const Key& key) const {
+        return mixHash(HashCode(HashPolicy::hash(key)));
+    }
+    static HashCode mixHash(HashCode hash) {
         // Multiply by golden ratio.
-        uint32_t hash = HashPolicy::hash(key) * 0x9E3779B9;
-        if (hash == Entry::kFreeHash || hash == Entry::kRemovedHash)
+        hash *= Width::kGoldenRatio;
+        if (hash == detail::HashTableEntry<Payload, HashCode>::kFreeHash ||
+            hash == detail::HashTableEntry<Payload, HashCode>::kRemovedHash)
+        {
             hash += 2;
+        }
         return hash;
     }
 
-    Entry* createTable(uint32_t capacity) {
-        assert(capacity <= kMaxCapacity);
-
-        Entry* table = (Entry*)this->am_malloc(capacity * sizeof(Entry));
-        if (!table)
-            return nullptr;
-
-        for (size_t i = 0; i < capacity; i++)
-            table[i].initialize();
-
-        return table;
-    }
-
   public:
     class Result
     {
         friend class HashTable;
 
-        Entry* entry_;
+        Slot slot_;
 
-        Entry& entry() {
-            return *entry_;
+        Slot& slot() {
+            return slot_;
         }
 
       public:
-        Result(Entry* entry)
-         : entry_(entry)
+        Result(const Slot& slot)
+         : slot_(slot)
         {}
 
         Payload* operator ->() {
-            return &entry_->payload();
+            return &slot_.payload();
         }
         Payload& operator *() {
-            return entry_->payload();
+            return slot_.payload();
         }
 
         bool found() const {
-            return entry_->isLive();
+            return slot_.isLive();
         }
     };
 
     class Insert : public Result
     {
-        uint32_t hash_;
+        HashCode hash_;
 
       public:
-        Insert(Entry* entry, uint32_t hash)
-         : Result(entry),
+        Insert(const Slot& slot, HashCode hash)
+         : Result(slot),
            hash_(hash)
         {}
 
-        uint32_t hash() const {
+        HashCode hash() const {
             return hash_;
         }
     };
 
   private:
-    class Probulator
-    {
-        uint32_t hash_;
-        uint32_t capacity_;
-
-      public:
-        Probulator(uint32_t hash, uint32_t capacity)
-         : hash_(hash),
-           capacity_(capacity)
-        {
-            assert(IsPowerOfTwo(capacity_));
-        }
-
-        uint32_t entry() const {
-            return hash_ & (capacity_ - 1);
-        }
-        uint32_t next() {
-            hash_++;
-            return entry();
-        }
-    };
-
     bool underloaded() const {
         // Check if the table is underloaded: < 25% entries used.
         return (capacity_ > kMinCapacity) && (nelements_ + ndeleted_ < capacity_ / 4);
     }
     bool overloaded() const {
-        // Grow if the table is overloaded: > 75% entries used.
-        return (nelements_ + ndeleted_) > ((capacity_ / 2) + (capacity_ / 4));
+        // Grow if the table is overloaded: more than kMaxLoadPercent (usually
+        // 75%) entries used.
+        return nelements_ + ndeleted_ > maxLoad(capacity_);
+    }
+
+    // The number of used slots allowed in a table of |capacity| slots. This
+    // is capacity * kMaxLoadPercent / 100, computed without overflowing.
+    static HashCode maxLoad(HashCode capacity) {
+        return capacity / 100 * Storage::kMaxLoadPercent +
+               capacity % 100 * Storage::kMaxLoadPercent / 100;
     }
 
     bool shrink() {
@@ -252,95 +1704,340 @@ class HashTable : private AllocPolicy
         return changeCapacity(capacity_ << 1);
     }
 
-    bool changeCapacity(uint32_t newCapacity) {
+    bool changeCapacity(HashCode newCapacity) {
         assert(newCapacity <= kMaxCapacity);
 
-        Entry* newTable = createTable(newCapacity);
-        if (!newTable)
+        if (Options::kResize == HashResize::Incremental)
+            return startMigration(newCapacity);
+
+        Storage newTable;
+        if (!newTable.allocate(&allocPolicy(), newCapacity))
             return false;
 
-        Entry* oldTable = table_;
-        uint32_t oldCapacity = capacity_;
+        // If the scratch array for a parallel rehash cannot be allocated,
+        // fall back to a serial one.
+        HashCode* order = nullptr;
+        if (kRehashThreads > 1 && nelements_ >= kParallelRehashMinimum)
+            order = (HashCode*)AllocPolicyTraits<AllocPolicy>::allocate(
+                &allocPolicy(), sizeof(HashCode) * size_t(nelements_));
 
-        table_ = newTable;
+        Storage oldTable(std::move(table_));
+        table_ = std::move(newTable);
         capacity_ = newCapacity;
         ndeleted_ = 0;
+        counters_.onRehash();
 
-        for (uint32_t i = 0; i < oldCapacity; i++) {
-            Entry& oldEntry = oldTable[i];
-            if (oldEntry.isLive()) {
-                Insert p = insertUnique(oldEntry.hash());
-                p.entry().setHash(p.hash());
-                p.entry().construct(std::move(oldEntry.payload()));
+        if (order) {
+            parallelRehash(oldTable, order);
+            AllocPolicyTraits<AllocPolicy>::release(&allocPolicy(), order,
+                                                    sizeof(HashCode) * size_t(nelements_));
+            oldTable.release(&allocPolicy());
+            return true;
+        }
+
+        HashCode oldCapacity = oldTable.capacity();
+        for (HashCode i = 0; i < oldCapacity; i++) {
+            Slot oldSlot = oldTable.slotAt(i);
+            if (oldSlot.isLive()) {
+                Slot slot = table_.insertUnique(oldSlot.hash());
+                table_.occupy(slot, oldSlot.hash());
+                table_.construct(slot, std::move(oldSlot.payload()));
+                counters_.onMove(sizeof(Payload));
             }
-            oldEntry.destruct();
         }
-        this->am_free(oldTable);
+        oldTable.release(&allocPolicy());
 
         return true;
     }
 
-    // For use when the key is known to be unique.
-    Insert insertUnique(uint32_t hash) {
-        Probulator probulator(hash, capacity_);
+    // Run |fn(0)| through |fn(kRehashThreads - 1)| on the policy's workers.
+    template <typename Fn>
+    static void runParallel(Fn fn) {
+        Options::RehashWorkers::run(kRehashThreads, fn);
+    }
 
-        Entry* e = &table_[probulator.entry()];
-        for (;;) {
-            if (e->isFree() || e->removed())
-                break;
-            e = &table_[probulator.next()];
+    // Move every entry of |oldTable| into the new, empty table_, using
+    // kRehashThreads threads. |order| must have room for every entry.
+    //
+    // The new table is split into one region per thread. The old table's
+    // entries are first sorted by the region of their new home slot, then
+    // each thread inserts the entries for its own region. A thread never
+    // probes past the end of its region: an entry whose cluster would spill
+    // over is deferred, and deferred entries are inserted afterwards on the
+    // calling thread. Since every probe sequence from an entry's home to its
+    // slot stays occupied either way, lookups find the same entries as if
+    // the table had been rebuilt serially.
+    void parallelRehash(Storage& oldTable, HashCode* order) {
+        const uint32_t kThreads = kRehashThreads;
+        HashCode oldCapacity = oldTable.capacity();
+        HashCode oldChunk = (oldCapacity + kThreads - 1) / kThreads;
+        HashCode region = (capacity_ + kThreads - 1) / kThreads;
+        HashCode mask = capacity_ - 1;
+
+        auto regionOf = [&](HashCode hash) -> uint32_t {
+            return uint32_t((hash & mask) / region);
+        };
+        auto forEachOld = [&](uint32_t thread, auto fn) {
+            HashCode begin = HashCode(thread) * oldChunk;
+            HashCode end = begin + oldChunk < oldCapacity ? begin + oldChunk : oldCapacity;
+            for (HashCode i = begin; i < end; i++) {
+                Slot slot = oldTable.slotAt(i);
+                if (slot.isLive())
+                    fn(i, slot);
+            }
+        };
+
+        // Count each thread's share of the old table by destination region,
+        // then turn the counts into offsets into |order|.
+        size_t offsets[kThreads][kThreads] = {};
+        runParallel([&](uint32_t thread) {
+            forEachOld(thread, [&](HashCode, const Slot& slot) {
+                offsets[thread][regionOf(slot.hash())]++;
+            });
+        });
+
+        size_t starts[kThreads + 1];
+        size_t position = 0;
+        for (uint32_t r = 0; r < kThreads; r++) {
+            starts[r] = position;
+            for (uint32_t thread = 0; thread < kThreads; thread++) {
+                size_t count = offsets[thread][r];
+                offsets[thread][r] = position;
+                position += count;
+            }
         }
+        starts[kThreads] = position;
+        assert(position == nelements_);
+
+        runParallel([&](uint32_t thread) {
+            forEachOld(thread, [&](HashCode i, const Slot& slot) {
+                order[offsets[thread][regionOf(slot.hash())]++] = i;
+            });
+        });
+
+        // Fill each region. Deferred entries are packed at the front of the
+        // region's part of |order|, behind the cursor.
+        size_t deferred[kThreads];
+        runParallel([&](uint32_t r) {
+            HashCode end = HashCode(r + 1) * region;
+            if (end > capacity_)
+                end = capacity_;
+
+            size_t ndeferred = 0;
+            for (size_t n = starts[r]; n < starts[r + 1]; n++) {
+                Slot oldSlot = oldTable.slotAt(order[n]);
+                HashCode hash = oldSlot.hash();
+                HashCode index = hash & mask;
+                while (index < end && table_.slotAt(index).isLive())
+                    index++;
+                if (index == end) {
+                    order[starts[r] + ndeferred++] = order[n];
+                    continue;
+                }
+
+                Slot slot = table_.slotAt(index);
+                table_.occupy(slot, hash);
+                table_.construct(slot, std::move(oldSlot.payload()));
+            }
+            deferred[r] = ndeferred;
+        });
+
+        for (uint32_t r = 0; r < kThreads; r++) {
+            for (size_t n = starts[r]; n < starts[r] + deferred[r]; n++) {
+                Slot oldSlot = oldTable.slotAt(order[n]);
+                Slot slot = table_.insertUnique(oldSlot.hash());
+                table_.occupy(slot, oldSlot.hash());
+                table_.construct(slot, std::move(oldSlot.payload()));
+            }
+        }
+        counters_.onMove(sizeof(Payload) * size_t(nelements_));
+    }
 
-        return Insert(e, hash);
+    bool startMigration(HashCode newCapacity) {
+        // Only one resize can be in flight at a time.
+        finishMigration();
+
+        Storage newTable;
+        if (!newTable.allocate(&allocPolicy(), newCapacity))
+            return false;
+
+        *migration_.table() = std::move(table_);
+        migration_.setCursor(0);
+        table_ = std::move(newTable);
+        capacity_ = newCapacity;
+        ndeleted_ = 0;
+        counters_.onRehash();
+        return true;
     }
 
-    template <typename Key>
-    Result lookup(const Key& key) const {
-        uint32_t hash = computeHash(key);
-        Probulator probulator(hash, capacity_);
+    // Move live entries out of the old table, scanning at most |budget| slots.
+    void migrate(HashCode budget) {
+        if (!migration_.active())
+            return;
 
-        Entry* e = &table_[probulator.entry()];
-        for (;;) {
-            if (e->isFree())
+        Storage* oldTable = migration_.table();
+        HashCode cursor = migration_.cursor();
+        HashCode end = oldTable->capacity();
+        for (; cursor < end && budget; cursor++, budget--) {
+            Slot oldSlot = oldTable->slotAt(cursor);
+            if (!oldSlot.isLive())
+                continue;
+
+            Slot slot = table_.insertUnique(oldSlot.hash());
+            table_.occupy(slot, oldSlot.hash());
+            table_.construct(slot, std::move(oldSlot.payload()));
+            oldTable->evict(oldSlot);
+            counters_.onMove(sizeof(Payload));
+        }
+
+        if (cursor == end)
+            oldTable->release(&allocPolicy());
+        else
+            migration_.setCursor(cursor);
+    }
+    void finishMigration() {
+        migrate(HashCode(-1));
+    }
+
+    static void scanForStats(const Storage& table, HashTableStats* stats, size_t* totalProbes) {
+        HashCode capacity = table.capacity();
+        if (!capacity)
+            return;
+
+        // Start just past a free slot, so that no cluster wraps around the
+        // end of the scan.
+        HashCode start = 0;
+        for (HashCode i = 0; i < capacity; i++) {
+            Slot slot = table.slotAt(i);
+            if (!slot.isLive() && !slot.removed()) {
+                start = i + 1;
                 break;
-            if (e->isLive() && e->sameHash(hash) && HashPolicy::matches(key, e->payload())) {
-                return Result(e);
             }
-            e = &table_[probulator.next()];
         }
 
-        return Result(e);
+        HashCode mask = capacity - 1;
+        size_t cluster = 0;
+        for (HashCode n = 0; n < capacity; n++) {
+            HashCode i = (start + n) & mask;
+            Slot slot = table.slotAt(i);
+            if (!slot.isLive() && !slot.removed()) {
+                cluster = 0;
+                continue;
+            }
+            cluster++;
+            if (cluster > stats->maxCluster)
+                stats->maxCluster = cluster;
+            if (!slot.isLive())
+                continue;
+
+            size_t probes = size_t((i - slot.hash()) & mask) / Storage::kProbeWidth + 1;
+            size_t bucket = probes - 1;
+            if (bucket >= HashTableStats::kProbeBuckets)
+                bucket = HashTableStats::kProbeBuckets - 1;
+            stats->probes[bucket]++;
+            if (probes > stats->maxProbeLength)
+                stats->maxProbeLength = probes;
+            *totalProbes += probes;
+        }
     }
 
-    template <typename Key>
-    Insert lookupForAdd(const Key& key) {
-        uint32_t hash = computeHash(key);
-        Probulator probulator(hash, capacity_);
+    // For use when the key is known to be unique.
+    Insert insertUnique(HashCode hash) {
+        return Insert(table_.insertUnique(hash), hash);
+    }
 
-        Entry* e = &table_[probulator.entry()];
-        Entry* firstRemoved = nullptr;
-        for (;;) {
-            if (e->isFree())
-                break;
-            if (e->removed()) {
-                if (!firstRemoved)
-                    firstRemoved = e;
-            } else if (e->sameHash(hash) && HashPolicy::matches(key, e->payload()))
-                break;
-            e = &table_[probulator.next()];
+    // Batched operations work on this many keys at a time.
+    static const size_t kBatchSize = 16;
+
+    template <typename Iter, typename KeyOf, typename PayloadOf>
+    bool addAll(Iter begin, Iter end, KeyOf keyOf, PayloadOf payloadOf,
+                std::forward_iterator_tag)
+    {
+        if (!reserve(nelements_ + size_t(std::distance(begin, end))))
+            return false;
+
+        HashCode hashes[kBatchSize];
+        while (begin != end) {
+            Iter batch = begin;
+            size_t count = prefetchBatch(begin, end, keyOf, hashes);
+            for (size_t i = 0; i < count; i++, ++batch) {
+                // The iterator may yield temporaries, which keyOf() can return
+                // a reference into.
+                auto&& item = *batch;
+                migrate(kMigrationStep);
+                Insert p = lookupForAdd(keyOf(item), hashes[i]);
+                if (p.found())
+                    continue;
+                if (!add(p, payloadOf(item)))
+                    return false;
+            }
+        }
+        return true;
+    }
+    template <typename Iter, typename KeyOf, typename PayloadOf>
+    bool addAll(Iter begin, Iter end, KeyOf keyOf, PayloadOf payloadOf,
+                std::input_iterator_tag)
+    {
+        for (; begin != end; ++begin) {
+            auto&& item = *begin;
+            Insert p = findForAdd(keyOf(item));
+            if (p.found())
+                continue;
+            if (!add(p, payloadOf(item)))
+                return false;
         }
+        return true;
+    }
 
-        if (!e->isLive() && firstRemoved)
-            e = firstRemoved;
+    // Hash up to kBatchSize keys starting at |begin|, prefetching the home
+    // slot of each, and advance |begin| past them. Returns the number of keys
+    // hashed.
+    template <typename Iter, typename KeyOf>
+    size_t prefetchBatch(Iter& begin, Iter end, KeyOf keyOf, HashCode* hashes) const {
+        size_t count = 0;
+        for (; begin != end && count < kBatchSize; ++begin, count++) {
+            hashes[count] = computeHash(keyOf(*begin));
+            table_.prefetch(hashes[count]);
+        }
+        return count;
+    }
+
+    // While an incremental resize is in progress, every key lives in exactly
+    // one of the two tables.
+    template <typename Key>
+    Result lookup(const Key& key) const {
+        return lookup(key, computeHash(key));
+    }
+    template <typename Key>
+    Result lookup(const Key& key, HashCode hash) const {
+        Slot slot = table_.template lookup<HashPolicy>(key, hash);
+        if (!slot.isLive() && migration_.active()) {
+            Slot oldSlot = migration_.table()->template lookupDraining<HashPolicy>(key, hash);
+            if (oldSlot.isLive())
+                return Result(oldSlot);
+        }
+        return Result(slot);
+    }
 
-        return Insert(e, hash);
+    template <typename Key>
+    Insert lookupForAdd(const Key& key) {
+        return lookupForAdd(key, computeHash(key));
+    }
+    template <typename Key>
+    Insert lookupForAdd(const Key& key, HashCode hash) {
+        if (migration_.active()) {
+            Slot oldSlot = migration_.table()->template lookupDraining<HashPolicy>(key, hash);
+            if (oldSlot.isLive())
+                return Insert(oldSlot, hash);
+        }
+        return Insert(table_.template lookupForAdd<HashPolicy>(key, hash), hash);
     }
 
     bool internalAdd(Insert& i) {
         assert(!i.found());
 
         // If the entry is deleted, just re-use the slot.
-        if (i.entry().removed()) {
+        if (i.slot().removed()) {
             ndeleted_--;
         } else {
             // Otherwise, see if we're at max capacity.
@@ -350,9 +2047,9 @@ class HashTable : private AllocPolicy
             }
 
             // Check if the table is over or underloaded. The table is always at
-            // least 25% free, so this check is enough to guarantee one free slot.
+            // least 10% free, so this check is enough to guarantee one free slot.
             // (Without one free slot, insertion search could infinite loop.)
-            uint32_t oldCapacity = capacity_;
+            HashCode oldCapacity = capacity_;
             if (!checkDensity())
                 return false;
 
@@ -364,14 +2061,15 @@ class HashTable : private AllocPolicy
         }
 
         nelements_++;
-        i.entry().setHash(i.hash());
+        table_.occupy(i.slot(), i.hash());
         return true;
     }
 
-    void removeEntry(Entry& e) {
-        assert(e.isLive());
-        e.setRemoved();
-        ndeleted_++;
+    void removeEntry(Slot& slot) {
+        assert(slot.isLive());
+        table_.remove(slot);
+        if (Storage::kLeavesTombstones)
+            ndeleted_++;
         nelements_--;
     }
 
@@ -381,7 +2079,6 @@ class HashTable : private AllocPolicy
        capacity_(0),
        nelements_(0),
        ndeleted_(0),
-       table_(nullptr),
        minCapacity_(kMinCapacity)
     {}
 
@@ -390,20 +2087,21 @@ class HashTable : private AllocPolicy
        capacity_(other.capacity_),
        nelements_(other.nelements_),
        ndeleted_(other.ndeleted_),
-       table_(other.table_),
-       minCapacity_(other.minCapacity_)
+       table_(std::move(other.table_)),
+       minCapacity_(other.minCapacity_),
+       counters_(other.counters_),
+       migration_(std::move(other.migration_))
     {
         other.capacity_ = 0;
         other.nelements_ = 0;
         other.ndeleted_ = 0;
-        other.table_ = nullptr;
         other.minCapacity_ = kMinCapacity;
     }
 
     ~HashTable() {
-        for (uint32_t i = 0; i < capacity_; i++)
-            table_[i].destruct();
-        this->am_free(table_);
+        if (migration_.active())
+            migration_.table()->release(&allocPolicy());
+        table_.release(&allocPolicy());
     }
 
     bool init(size_t capacity = 0) {
@@ -414,30 +2112,111 @@ class HashTable : private AllocPolicy
             return false;
         }
 
-        minCapacity_ = uint32_t(capacity);
+        minCapacity_ = HashCode(capacity);
 
         assert(IsPowerOfTwo(capacity));
-        capacity_ = uint32_t(capacity);
+        capacity_ = HashCode(capacity);
 
-        table_ = createTable(capacity_);
-        if (!table_)
+        if (!table_.allocate(&allocPolicy(), capacity_))
             return false;
 
         return true;
     }
 
+    // Ensure the table can hold |count| elements without growing. Unlike
+    // init(), |count| does not need to be a power of two. If the table has
+    // not been initialized, this initializes it. The table will not shrink
+    // below the reserved size.
+    bool reserve(size_t count) {
+        size_t capacity = kMinCapacity;
+        while (count > maxLoad(HashCode(capacity))) {
+            if (capacity >= kMaxCapacity) {
+                this->reportAllocationOverflow();
+                return false;
+            }
+            capacity <<= 1;
+        }
+        if (capacity > kMaxCapacity) {
+            this->reportAllocationOverflow();
+            return false;
+        }
+
+        if (!capacity_)
+            return init(capacity);
+
+        if (capacity > minCapacity_)
+            minCapacity_ = HashCode(capacity);
+        if (capacity <= capacity_)
+            return true;
+        return changeCapacity(HashCode(capacity));
+    }
+
+    // Add each item in [begin, end) whose key is not already present.
+    // |keyOf(item)| gives the key to look up, and |payloadOf(item)| gives the
+    // value to construct the payload from.
+    //
+    // With forward iterators, the table is reserved up front, and items are
+    // processed in small batches: every key in a batch is hashed and its home
+    // slot prefetched before any of them are probed, so that the cache misses
+    // overlap. Both need more than one pass over the range, so single-pass
+    // input iterators instead add their items one at a time.
+    template <typename Iter, typename KeyOf, typename PayloadOf>
+    bool addAll(Iter begin, Iter end, KeyOf keyOf, PayloadOf payloadOf) {
+        typedef typename std::iterator_traits<Iter>::iterator_category Category;
+        return addAll(begin, end, keyOf, payloadOf, Category());
+    }
+
     // The Result object must not be used past mutating table operations.
     template <typename Key>
     Result find(const Key& key) const {
         return lookup(key);
     }
 
+    // Look up every key in [begin, end), writing a Result for each to |out|,
+    // in order. This is faster than calling find() in a loop when the table
+    // does not fit in cache: keys are hashed and their home slots prefetched
+    // in batches before being probed, so the memory latency of each lookup
+    // overlaps with the others. Returns the advanced output iterator.
+    // KeyIter must be a forward iterator, since each batch is read twice.
+    //
+    // As with find(), the Results must not be used past mutating operations.
+    template <typename KeyIter, typename OutIter>
+    OutIter findMany(KeyIter begin, KeyIter end, OutIter out) const {
+        typedef decltype(*begin) Key;
+
+        HashCode hashes[kBatchSize];
+        while (begin != end) {
+            KeyIter batch = begin;
+            size_t count = prefetchBatch(begin, end, [](Key key) -> Key { return key; }, hashes);
+            for (size_t i = 0; i < count; i++, ++batch)
+                *out++ = lookup(*batch, hashes[i]);
+        }
+        return out;
+    }
+
     // The Insert object must not be used past mutating table operations.
+    //
+    // With HashResize::Incremental, this counts as a mutating operation,
+    // since it migrates part of the old table before searching.
     template <typename Key>
     Insert findForAdd(const Key& key) {
+        migrate(kMigrationStep);
         return lookupForAdd(key);
     }
 
+    // Variants of find() and findForAdd() for when the key's hash is already
+    // known, for example because it was saved from an earlier lookup. |hash|
+    // must be the value of HashPolicy::hash(key); it is not recomputed.
+    template <typename Key>
+    Result find(HashCode hash, const Key& key) const {
+        return lookup(key, mixHash(hash));
+    }
+    template <typename Key>
+    Insert findForAdd(HashCode hash, const Key& key) {
+        migrate(kMigrationStep);
+        return lookupForAdd(key, mixHash(hash));
+    }
+
     template <typename Key>
     void removeIfExists(const Key& key) {
         Result r = find(key);
@@ -448,22 +2227,25 @@ class HashTable : private AllocPolicy
 
     void remove(Result& r) {
         assert(r.found());
-        removeEntry(r.entry());
+        if (migration_.active() && migration_.table()->owns(r.slot())) {
+            migration_.table()->evict(r.slot());
+            nelements_--;
+        } else {
+            removeEntry(r.slot());
+        }
+        migrate(kMigrationStep);
     }
 
     // The table must not have been mutated in between findForAdd() and add().
     // The Insert object is still valid after add() returns, however.
-    template <typename U>
-    bool add(Insert& i, U&& payload) {
-        if (!internalAdd(i))
-            return false;
-        i.entry().construct(std::forward<U>(payload));
-        return true;
-    }
-    bool add(Insert& i) {
+    //
+    // The payload is constructed in place from |args|, which are left
+    // untouched if the table runs out of memory.
+    template <typename... Args>
+    bool add(Insert& i, Args&&... args) {
         if (!internalAdd(i))
             return false;
-        i.entry().construct();
+        table_.construct(i.slot(), std::forward<Args>(args)...);
         return true;
     }
 
@@ -476,9 +2258,9 @@ class HashTable : private AllocPolicy
     }
 
     void clear() {
-        for (size_t i = 0; i < capacity_; i++) {
-            table_[i].setFree();
-        }
+        if (migration_.active())
+            migration_.table()->release(&allocPolicy());
+        table_.clear();
         ndeleted_ = 0;
         nelements_ = 0;
     }
@@ -495,20 +2277,49 @@ class HashTable : private AllocPolicy
     }
 
     size_t estimateMemoryUse() const {
-        return sizeof(Entry) * capacity_;
+        size_t bytes = table_.memoryUse();
+        if (migration_.active())
+            bytes += migration_.table()->memoryUse();
+        return bytes;
+    }
+
+    // Scan the table to describe how well its entries are spread out. This
+    // is O(capacity), and is meant for diagnosing slow tables: long probe
+    // sequences point to a weak hash function, and a high tombstone ratio to
+    // heavy removal churn. During an incremental resize, both tables are
+    // scanned.
+    HashTableStats stats() const {
+        HashTableStats stats;
+        stats.capacity = capacity_;
+        stats.elements = nelements_;
+        stats.tombstones = ndeleted_;
+        stats.rehashes = counters_.rehashes();
+        stats.bytesMoved = counters_.bytesMoved();
+
+        size_t totalProbes = 0;
+        scanForStats(table_, &stats, &totalProbes);
+        if (migration_.active())
+            scanForStats(*migration_.table(), &stats, &totalProbes);
+        if (nelements_)
+            stats.averageProbeLength = double(totalProbes) / double(nelements_);
+        return stats;
     }
 
   public:
-    // It is illegal to mutate a HashTable during iteration.
+    // It is illegal to mutate a HashTable during iteration. Creating an
+    // iterator completes any incremental resize in progress, since iteration
+    // visits every slot anyway.
     class iterator
     {
       public:
         iterator(HashTable* table)
-         : table_(table),
-           i_(table->table_),
-           end_(table->table_ + table->capacity_)
+         : table_(prepare(table)),
+           start_(table->table_.iterationStart()),
+           i_(0),
+           end_(table->table_.capacity()),
+           revisit_(false)
         {
-            while (i_ < end_ && !i_->isLive())
+            while (i_ < end_ && !current().isLive())
                 i_++;
         }
 
@@ -518,26 +2329,46 @@ class HashTable : private AllocPolicy
 
         void erase() {
             assert(!empty());
-            table_->removeEntry(*i_);
+            Slot slot = current();
+            table_->removeEntry(slot);
+
+            // If removal shifted a later entry into this slot, the next call
+            // to next() must not skip over it.
+            revisit_ = current().isLive();
         }
 
         Payload* operator ->() const {
-            return &i_->payload();
+            return &current().payload();
         }
         Payload& operator *() const {
-            return i_->payload();
+            return current().payload();
         }
 
         void next() {
+            if (revisit_) {
+                revisit_ = false;
+                return;
+            }
             do {
                 i_++;
-            } while (i_ < end_ && !i_->isLive());
+            } while (i_ < end_ && !current().isLive());
+        }
+
+      private:
+        static HashTable* prepare(HashTable* table) {
+            table->finishMigration();
+            return table;
+        }
+        Slot current() const {
+            return table_->table_.slotAt((start_ + i_) & (end_ - 1));
         }
 
       private:
         HashTable* table_;
-        Entry* i_;
-        Entry* end_;
+        HashCode start_;
+        HashCode i_;
+        HashCode end_;
+        bool revisit_;
     };
 
   private:
@@ -545,11 +2376,13 @@ class HashTable : private AllocPolicy
     HashTable& operator =(const HashTable& other) = delete;
 
   private:
-    uint32_t capacity_;
-    uint32_t nelements_;
-    uint32_t ndeleted_;
-    Entry* table_;
-    uint32_t minCapacity_;
+    HashCode capacity_;
+    HashCode nelements_;
+    HashCode ndeleted_;
+    Storage table_;
+    HashCode minCapacity_;
+    Counters counters_;
+    Migration migration_;
 };
 
 // Bob Jenkin's one-at-a-time hash function[1].
@@ -560,22 +2393,22 @@ class CharacterStreamHasher
     uint32_t hash;
 
   public:
-    CharacterStreamHasher()
+    constexpr CharacterStreamHasher()
      : hash(0)
     {}
 
-    void add(char c) {
+    constexpr void add(char c) {
         hash += c;
         hash += (hash << 10);
         hash ^= (hash >> 6);
     }
 
-    void add(const char* s, size_t length) {
+    constexpr void add(const char* s, size_t length) {
         for (size_t i = 0; i < length; i++)
             add(s[i]);
     }
 
-    uint32_t result() {
+    constexpr uint32_t result() {
         hash += (hash << 3);
         hash ^= (hash >> 11);
         hash += (hash << 15);
@@ -583,7 +2416,7 @@ class CharacterStreamHasher
     }
 };
 
-static inline uint32_t
+static constexpr uint32_t
 HashCharSequence(const char* s, size_t length)
 {
     CharacterStreamHasher hasher;
@@ -591,7 +2424,7 @@ HashCharSequence(const char* s, size_t length)
     return hasher.result();
 }
 
-static inline uint32_t
+static constexpr uint32_t
 FastHashCharSequence(const char* s, size_t length)
 {
     uint32_t hash = 0;
@@ -600,28 +2433,254 @@ FastHashCharSequence(const char* s, size_t length)
     return hash;
 }
 
+namespace detail {
+
+// Constants and primitives for HashCharSequence64, which is based on
+// wyhash[1] by Wang Yi.
+//
+// [1] https://github.com/wangyi-fudan/wyhash
+static const uint64_t kWyP0 = 0x2d358dccaa6c78a5ull;
+static const uint64_t kWyP1 = 0x8bb84b93962eacc9ull;
+static const uint64_t kWyP2 = 0x4b33a62ed433d4a3ull;
+static const uint64_t kWyP3 = 0x4d5a2da51de1aa47ull;
+
+// Compute the full 128-bit product of |*a| and |*b|, storing the low half in
+// |*a| and the high half in |*b|.
+static inline void
+WyMultiply(uint64_t* a, uint64_t* b)
+{
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = __uint128_t(*a) * *b;
+    *a = uint64_t(r);
+    *b = uint64_t(r >> 64);
+#elif defined(KE_CXX_MSVC) && defined(KE_ARCH_X64)
+    *a = _umul128(*a, *b, b);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32, la = uint32_t(*a), lb = uint32_t(*b);
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32);
+    uint64_t carry = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    carry += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + carry;
+#endif
+}
+
+static inline uint64_t
+WyMix(uint64_t a, uint64_t b)
+{
+    WyMultiply(&a, &b);
+    return a ^ b;
+}
+
+// Unaligned native-endian reads. Hash values therefore differ between little
+// and big endian machines, which is fine for in-memory tables.
+static inline uint64_t
+WyRead8(const uint8_t* p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline uint64_t
+WyRead4(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// Read 1 to 3 bytes.
+static inline uint64_t
+WyRead3(const uint8_t* p, size_t length)
+{
+    return (uint64_t(p[0]) << 16) | (uint64_t(p[length >> 1]) << 8) | p[length - 1];
+}
+
+static inline uint64_t
+WySeed(uint64_t seed)
+{
+    return seed ^ WyMix(seed ^ kWyP0, kWyP1);
+}
+
+static inline uint64_t
+WyFinish(uint64_t a, uint64_t b, uint64_t seed, size_t length)
+{
+    a ^= kWyP1;
+    b ^= seed;
+    WyMultiply(&a, &b);
+    return WyMix(a ^ kWyP0 ^ length, b ^ kWyP1);
+}
+
+// Hash an input of at most 16 bytes.
+static inline uint64_t
+WyHashShort(const uint8_t* p, size_t length, uint64_t seed)
+{
+    uint64_t a, b;
+    if (length >= 4) {
+        size_t offset = (length >> 3) << 2;
+        a = (WyRead4(p) << 32) | WyRead4(p + offset);
+        b = (WyRead4(p + length - 4) << 32) | WyRead4(p + length - 4 - offset);
+    } else if (length > 0) {
+        a = WyRead3(p, length);
+        b = 0;
+    } else {
+        a = b = 0;
+    }
+    return WyFinish(a, b, seed, length);
+}
+
+// Consume one 48-byte block of an input longer than 48 bytes.
+static inline void
+WyHashBlock(const uint8_t* p, uint64_t* seed, uint64_t* see1, uint64_t* see2)
+{
+    *seed = WyMix(WyRead8(p) ^ kWyP1, WyRead8(p + 8) ^ *seed);
+    *see1 = WyMix(WyRead8(p + 16) ^ kWyP2, WyRead8(p + 24) ^ *see1);
+    *see2 = WyMix(WyRead8(p + 32) ^ kWyP3, WyRead8(p + 40) ^ *see2);
+}
+
+// Hash the final |remaining| bytes (between 1 and 48) at |p| of an input
+// longer than 16 bytes. The 16 bytes before |p| must be readable and hold
+// the preceding input.
+static inline uint64_t
+WyHashTail(const uint8_t* p, size_t remaining, uint64_t seed, size_t length)
+{
+    while (remaining > 16) {
+        seed = WyMix(WyRead8(p) ^ kWyP1, WyRead8(p + 8) ^ seed);
+        p += 16;
+        remaining -= 16;
+    }
+    return WyFinish(WyRead8(p + remaining - 16), WyRead8(p + remaining - 8), seed, length);
+}
+
+} // namespace detail
+
+// A 64-bit string hash that consumes up to 48 bytes per step, based on
+// wyhash. It is much faster than HashCharSequence and FastHashCharSequence on
+// all but the shortest strings, and has good avalanche behavior, so its low
+// 32 bits are suitable for HashPolicy::hash().
+static inline uint64_t
+HashCharSequence64(const char* s, size_t length, uint64_t seed = 0)
+{
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(s);
+    seed = detail::WySeed(seed);
+
+    if (KE_CRITICAL_LIKELY(length <= 16))
+        return detail::WyHashShort(p, length, seed);
+
+    size_t remaining = length;
+    if (remaining > 48) {
+        uint64_t see1 = seed, see2 = seed;
+        do {
+            detail::WyHashBlock(p, &seed, &see1, &see2);
+            p += 48;
+            remaining -= 48;
+        } while (remaining > 48);
+        seed ^= see1 ^ see2;
+    }
+    return detail::WyHashTail(p, remaining, seed, length);
+}
+
+// A streaming counterpart to HashCharSequence64: adding a string in any
+// number of pieces gives the same result as hashing it in one call.
+class WordStreamHasher
+{
+  public:
+    explicit WordStreamHasher(uint64_t seed = 0)
+     : seed_(detail::WySeed(seed)),
+       see1_(seed_),
+       see2_(seed_),
+       length_(0),
+       pending_(0)
+    {}
+
+    void add(char c) {
+        add(&c, 1);
+    }
+
+    void add(const char* s, size_t length) {
+        length_ += length;
+        while (length) {
+            size_t n = kPendingSize - pending_;
+            if (n > length)
+                n = length;
+            memcpy(buffer_ + kHistorySize + pending_, s, n);
+            pending_ += n;
+            s += n;
+            length -= n;
+
+            // A block can only be consumed once it's known not to hold the
+            // end of the input, as HashCharSequence64 treats the last 48
+            // bytes differently.
+            if (pending_ > kBlockSize)
+                consumeBlock();
+        }
+    }
+
+    uint64_t result() const {
+        const uint8_t* pending = buffer_ + kHistorySize;
+        if (length_ <= 16)
+            return detail::WyHashShort(pending, length_, seed_);
+
+        uint64_t seed = seed_;
+        if (length_ > kBlockSize)
+            seed ^= see1_ ^ see2_;
+        return detail::WyHashTail(pending, pending_, seed, length_);
+    }
+
+  private:
+    void consumeBlock() {
+        uint8_t* pending = buffer_ + kHistorySize;
+        detail::WyHashBlock(pending, &seed_, &see1_, &see2_);
+
+        // Keep the end of the block, since the tail may read back into it.
+        memcpy(buffer_, pending + kBlockSize - kHistorySize, kHistorySize);
+        pending_ -= kBlockSize;
+        memmove(pending, pending + kBlockSize, pending_);
+    }
+
+  private:
+    static const size_t kBlockSize = 48;
+    static const size_t kHistorySize = 16;
+    static const size_t kPendingSize = 64;
+
+    uint64_t seed_;
+    uint64_t see1_;
+    uint64_t see2_;
+    size_t length_;
+    size_t pending_;
+    uint8_t buffer_[kHistorySize + kPendingSize];
+};
+
 // From http://burtleburtle.net/bob/hash/integer.html
-static inline uint32_t
-HashInt32(int32_t a)
+//
+// The arithmetic is unsigned, so that it is well-defined (and usable in
+// constant expressions); the right shifts are arithmetic, as in the original.
+static constexpr uint32_t
+HashInt32(int32_t key)
 {
-    a = (a ^ 61) ^ (a >> 16);
+    uint32_t a = uint32_t(key);
+    a = (a ^ 61) ^ uint32_t(int32_t(a) >> 16);
     a = a + (a << 3);
-    a = a ^ (a >> 4);
+    a = a ^ uint32_t(int32_t(a) >> 4);
     a = a * 0x27d4eb2d;
-    a = a ^ (a >> 15);
+    a = a ^ uint32_t(int32_t(a) >> 15);
     return a;
 }
 
 // From http://www.cris.com/~Ttwang/tech/inthash.htm
-static inline uint32_t
-HashInt64(int64_t key)
+static constexpr uint32_t
+HashInt64(int64_t value)
 {
+    uint64_t key = uint64_t(value);
     key = (~key) + (key << 18); // key = (key << 18) - key - 1;
-    key = key ^ (uint64_t(key) >> 31);
+    key = key ^ (key >> 31);
     key = key * 21; // key = (key + (key << 2)) + (key << 4);
-    key = key ^ (uint64_t(key) >> 11);
+    key = key ^ (key >> 11);
     key = key + (key << 6);
-    key = key ^ (uint64_t(key) >> 22);
+    key = key ^ (key >> 22);
     return uint32_t(key);
 }
 
@@ -0,0 +1,529 @@
+// vim: set sts=8 ts=4 sw=4 tw=99 et:
+//
+// Copyright (C) 2026 David Anderson and AlliedModders LLC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of AlliedModders LLC nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <new>
+#include <utility>
+
+#include <amtl/am-hashtable.h>
+#include <amtl/am-storagebuffer.h>
+
+namespace ke {
+
+// A map that remembers the order in which keys were added. Entries are kept
+// in a packed array, in insertion order, and a HashTable of indices into that
+// array is used for lookups. Iteration walks the array, so it visits entries
+// in a stable order and touches contiguous memory, rather than every slot of
+// a sparse hash table.
+//
+// Removing an entry leaves a hole in the array, which iteration skips. Holes
+// are reclaimed when the array next fills up, once they outnumber the
+// remaining entries, or by calling compact(). All of these preserve the
+// order of the remaining entries, and iteration stays O(elements()).
+//
+// The API and template parameters match HashMap. Re-adding a key that was
+// removed puts it at the end of the order; changing the value of an existing
+// entry does not move it.
+template <typename K, typename V, typename HashPolicy, typename AllocPolicy = SystemAllocatorPolicy>
+class OrderedHashMap
+{
+  public:
+    struct Entry {
+        K key;
+        V value;
+
+        Entry(Entry&& other)
+         : key(std::move(other.key)),
+           value(std::move(other.value))
+        {}
+
+        template <typename UK, typename UV>
+        Entry(UK&& aKey, UV&& aValue)
+         : key(std::forward<UK>(aKey)),
+           value(std::forward<UV>(aValue))
+        {}
+    };
+
+  private:
+    struct Item;
+
+    // The index table stores positions in the item array, so matching a key
+    // needs the array as well.
+    template <typename Lookup>
+    struct IndexLookup {
+        const Lookup& key;
+        const Item* items;
+    };
+
+    // Matches the index of a particular item, whatever its key.
+    struct IndexPosition {
+        uint32_t index;
+    };
+
+    struct Policy : public detail::HashPolicyOptions<HashPolicy> {
+        typedef uint32_t Payload;
+
+        template <typename Lookup>
+        static auto hash(const IndexLookup<Lookup>& lookup) -> decltype(HashPolicy::hash(lookup.key)) {
+            return HashPolicy::hash(lookup.key);
+        }
+
+        template <typename Lookup>
+        static bool matches(const IndexLookup<Lookup>& lookup, uint32_t index) {
+            return HashPolicy::matches(lookup.key, lookup.items[index].entry()->key);
+        }
+        static bool matches(const IndexPosition& position, uint32_t index) {
+            return position.index == index;
+        }
+    };
+
+    typedef HashTable<Policy, AllocPolicy> Index;
+
+  public:
+    typedef typename Index::HashCode HashCode;
+
+  private:
+    // The key's hash is kept so that its index can be found again when the
+    // item moves, without rehashing the key.
+    struct Item {
+        StorageBuffer<Entry> storage;
+        HashCode hash;
+        bool live;
+
+        Entry* entry() {
+            return storage.address();
+        }
+        const Entry* entry() const {
+            return storage.address();
+        }
+    };
+
+    static const uint32_t kMinItems = 8;
+    static const uint32_t kMaxItems = uint32_t(1) << 31;
+
+  public:
+    explicit OrderedHashMap(AllocPolicy ap = AllocPolicy())
+     : index_(ap),
+       items_(nullptr),
+       count_(0),
+       removed_(0),
+       capacity_(0)
+    {}
+
+    OrderedHashMap(OrderedHashMap&& other)
+     : index_(std::move(other.index_)),
+       items_(other.items_),
+       count_(other.count_),
+       removed_(other.removed_),
+       capacity_(other.capacity_)
+    {
+        other.items_ = nullptr;
+        other.count_ = 0;
+        other.removed_ = 0;
+        other.capacity_ = 0;
+    }
+
+    ~OrderedHashMap() {
+        destroyItems();
+        AllocPolicyTraits<AllocPolicy>::release(&allocPolicy(), items_,
+                                                sizeof(Item) * size_t(capacity_), alignof(Item));
+    }
+
+    // capacity must be a power of two.
+    bool init(size_t capacity = 16) {
+        return index_.init(capacity);
+    }
+
+    // Ensure the map can hold |count| entries without growing. |count| does
+    // not need to be a power of two.
+    bool reserve(size_t count) {
+        if (!index_.reserve(count))
+            return false;
+        if (count <= size_t(capacity_ - count_) + elements())
+            return true;
+        if (count > kMaxItems) {
+            allocPolicy().reportAllocationOverflow();
+            return false;
+        }
+        compact();
+        if (count <= capacity_)
+            return true;
+        return resizeItems(uint32_t(count));
+    }
+
+    class Result
+    {
+        friend class OrderedHashMap;
+
+        typename Index::Result index_;
+        Entry* entry_;
+
+        Result(const typename Index::Result& index, Entry* entry)
+         : index_(index),
+           entry_(entry)
+        {}
+
+      public:
+        Entry* operator ->() {
+            return entry_;
+        }
+        Entry& operator *() {
+            return *entry_;
+        }
+
+        bool found() const {
+            return !!entry_;
+        }
+    };
+
+    class Insert
+    {
+        friend class OrderedHashMap;
+
+        typename Index::Insert index_;
+        Entry* entry_;
+        HashCode hash_;
+
+        Insert(const typename Index::Insert& index, Entry* entry, HashCode hash)
+         : index_(index),
+           entry_(entry),
+           hash_(hash)
+        {}
+
+      public:
+        Entry* operator ->() {
+            return entry_;
+        }
+        Entry& operator *() {
+            return *entry_;
+        }
+
+        bool found() const {
+            return !!entry_;
+        }
+    };
+
+    // The Result object must not be used past mutating operations.
+    template <typename Lookup>
+    Result find(const Lookup& key) const {
+        return toResult(index_.find(IndexLookup<Lookup>{key, items_}));
+    }
+
+    // The Insert object must not be used past mutating operations.
+    template <typename Lookup>
+    Insert findForAdd(const Lookup& key) {
+        return findForAdd(HashCode(HashPolicy::hash(key)), key);
+    }
+
+    // Lookups with a precomputed hash; see HashTable::find(hash, key).
+    template <typename Lookup>
+    Result find(HashCode hash, const Lookup& key) const {
+        return toResult(index_.find(hash, IndexLookup<Lookup>{key, items_}));
+    }
+    template <typename Lookup>
+    Insert findForAdd(HashCode hash, const Lookup& key) {
+        return toInsert(index_.findForAdd(hash, IndexLookup<Lookup>{key, items_}), hash);
+    }
+
+    // The map must not have been mutated in between findForAdd() and add().
+    // The Insert object is still valid after add() returns, however. The new
+    // entry goes at the end of the order.
+    template <typename UK, typename UV>
+    bool add(Insert& i, UK&& key, UV&& value) {
+        assert(!i.found());
+
+        // Growing or compacting the item array only rewrites the indices
+        // stored in the table, so |i| stays valid.
+        if (count_ == capacity_ && !growItems())
+            return false;
+        if (!index_.add(i.index_, count_))
+            return false;
+
+        Item& item = items_[count_++];
+        new (item.entry()) Entry(std::forward<UK>(key), std::forward<UV>(value));
+        item.hash = i.hash_;
+        item.live = true;
+        i.entry_ = item.entry();
+        return true;
+    }
+    template <typename UK>
+    bool add(Insert& i, UK&& key) {
+        return add(i, std::forward<UK>(key), V());
+    }
+
+    template <typename Lookup>
+    void removeIfExists(const Lookup& key) {
+        Result r = find(key);
+        if (!r.found())
+            return;
+        remove(r);
+    }
+
+    void remove(Result& r) {
+        assert(r.found());
+        uint32_t index = *r.index_;
+        index_.remove(r.index_);
+        removeItem(index);
+        compactIfSparse();
+        r.entry_ = nullptr;
+    }
+
+    void clear() {
+        destroyItems();
+        index_.clear();
+    }
+
+    // Close up the holes left by removed entries, keeping the remaining
+    // entries in order.
+    void compact() {
+        if (!removed_)
+            return;
+
+        uint32_t to = 0;
+        for (uint32_t from = 0; from < count_; from++) {
+            Item& item = items_[from];
+            if (!item.live)
+                continue;
+
+            // Entries before |from| have already been moved and renumbered,
+            // and entries after it have not been touched, so every index in
+            // the table still refers to the right entry.
+            if (to != from) {
+                typename Index::Result r = index_.find(item.hash, IndexPosition{from});
+                assert(r.found());
+                *r = to;
+
+                new (items_[to].entry()) Entry(std::move(*item.entry()));
+                items_[to].hash = item.hash;
+                items_[to].live = true;
+                item.entry()->~Entry();
+                item.live = false;
+            }
+            to++;
+        }
+        count_ = to;
+        removed_ = 0;
+    }
+
+    size_t elements() const {
+        return count_ - removed_;
+    }
+
+    // The number of array slots that iteration walks: elements() plus any
+    // holes not yet reclaimed. Outside of iteration, this is at most twice
+    // elements().
+    size_t slotsUsed() const {
+        return count_;
+    }
+
+    size_t estimateMemoryUse() const {
+        return index_.estimateMemoryUse() + sizeof(Item) * capacity_;
+    }
+
+    AllocPolicy& allocPolicy() {
+        return index_.allocPolicy();
+    }
+    const AllocPolicy& allocPolicy() const {
+        return index_.allocPolicy();
+    }
+
+    // Visits entries in insertion order. It is illegal to mutate the map
+    // during iteration, other than through erase().
+    class iterator
+    {
+      public:
+        explicit iterator(OrderedHashMap* map)
+         : map_(map),
+           i_(0)
+        {
+            skipRemoved();
+        }
+
+        bool empty() const {
+            return i_ >= map_->count_;
+        }
+
+        void erase() {
+            assert(!empty());
+            typename Index::Result r =
+                map_->index_.find(map_->items_[i_].hash, IndexPosition{i_});
+            assert(r.found());
+            map_->index_.remove(r);
+            map_->removeItem(i_);
+        }
+
+        Entry* operator ->() const {
+            return &**this;
+        }
+        Entry& operator *() const {
+            assert(!empty());
+            return *map_->items_[i_].entry();
+        }
+
+        void next() {
+            i_++;
+            skipRemoved();
+
+            // Holes left by erase() cannot be closed up mid-iteration, since
+            // that would move the entries still to be visited.
+            if (empty())
+                map_->compactIfSparse();
+        }
+
+      private:
+        void skipRemoved() {
+            while (i_ < map_->count_ && !map_->items_[i_].live)
+                i_++;
+        }
+
+      private:
+        OrderedHashMap* map_;
+        uint32_t i_;
+    };
+
+    iterator iter() {
+        return iterator(this);
+    }
+
+  private:
+    Result toResult(typename Index::Result r) const {
+        return Result(r, r.found() ? entryAt(*r) : nullptr);
+    }
+    Insert toInsert(typename Index::Insert i, HashCode hash) const {
+        return Insert(i, i.found() ? entryAt(*i) : nullptr, hash);
+    }
+
+    Entry* entryAt(uint32_t index) const {
+        assert(index < count_ && items_[index].live);
+        return const_cast<Entry*>(items_[index].entry());
+    }
+
+    void removeItem(uint32_t index) {
+        Item& item = items_[index];
+        assert(item.live);
+        item.entry()->~Entry();
+        item.live = false;
+        removed_++;
+
+        // Once the last entry is gone there is nothing to renumber, so the
+        // array can start over from the beginning.
+        if (removed_ == count_) {
+            count_ = 0;
+            removed_ = 0;
+        }
+    }
+
+    // Compacting once holes outnumber entries costs O(slotsUsed()), which is
+    // paid for by the removals that made the holes.
+    void compactIfSparse() {
+        if (removed_ > count_ / 2)
+            compact();
+    }
+
+    void destroyItems() {
+        for (uint32_t i = 0; i < count_; i++) {
+            if (items_[i].live)
+                items_[i].entry()->~Entry();
+        }
+        count_ = 0;
+        removed_ = 0;
+    }
+
+    // Called when the item array is full. If at least a quarter of it is
+    // holes, compacting frees enough room; otherwise the array doubles.
+    bool growItems() {
+        if (removed_ && removed_ >= capacity_ / 4) {
+            compact();
+            return true;
+        }
+        if (capacity_ >= kMaxItems) {
+            allocPolicy().reportAllocationOverflow();
+            return false;
+        }
+        return resizeItems(capacity_ ? capacity_ * 2 : kMinItems);
+    }
+
+    // Entries keep their positions, so the index table is unchanged.
+    bool resizeItems(uint32_t capacity) {
+        assert(capacity >= count_);
+        if (capacity < kMinItems)
+            capacity = kMinItems;
+
+        // Entries of trivially relocatable keys and values can be moved with
+        // the array, which may not need to move at all.
+        if (IsTriviallyRelocatable<K>::value && IsTriviallyRelocatable<V>::value) {
+            Item* items = (Item*)AllocPolicyTraits<AllocPolicy>::reallocate(
+                &allocPolicy(), items_, sizeof(Item) * size_t(capacity_),
+                sizeof(Item) * size_t(capacity), alignof(Item));
+            if (!items)
+                return false;
+            items_ = items;
+            capacity_ = capacity;
+            return true;
+        }
+
+        Item* items = (Item*)AllocPolicyTraits<AllocPolicy>::allocate(
+            &allocPolicy(), sizeof(Item) * size_t(capacity), alignof(Item));
+        if (!items)
+            return false;
+
+        for (uint32_t i = 0; i < count_; i++) {
+            items[i].live = items_[i].live;
+            if (!items_[i].live)
+                continue;
+            items[i].hash = items_[i].hash;
+            new (items[i].entry()) Entry(std::move(*items_[i].entry()));
+            items_[i].entry()->~Entry();
+        }
+        AllocPolicyTraits<AllocPolicy>::release(&allocPolicy(), items_,
+                                                sizeof(Item) * size_t(capacity_), alignof(Item));
+        items_ = items;
+        capacity_ = capacity;
+        return true;
+    }
+
+  private:
+    OrderedHashMap(const OrderedHashMap& other) = delete;
+    OrderedHashMap& operator =(const OrderedHashMap& other) = delete;
+
+  private:
+    Index index_;
+    Item* items_;
+    uint32_t count_;
+    uint32_t removed_;
+    uint32_t capacity_;
+};
+
+} // namespace ke
@@ -0,0 +1,305 @@
+// vim: set sts=8 ts=4 sw=4 tw=99 et:
+//
+// Copyright (C) 2026 David Anderson and AlliedModders LLC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of AlliedModders LLC nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <amtl/am-hashtable.h>
+
+namespace ke {
+
+// A key and value for PerfectHashMap.
+template <typename K, typename V>
+struct PerfectHashEntry {
+    K key;
+    V value;
+};
+
+namespace detail {
+
+static constexpr size_t
+ConstStrlen(const char* s)
+{
+    size_t length = 0;
+    while (s[length])
+        length++;
+    return length;
+}
+
+// The number of slots for |count| keys: the next power of two.
+static constexpr size_t
+PerfectHashSlots(size_t count)
+{
+    size_t slots = 1;
+    while (slots < count)
+        slots *= 2;
+    return slots;
+}
+
+// Not constexpr, so that calling it during constant evaluation is a compile
+// error naming the problem.
+static inline void
+PerfectHashKeysCollide()
+{
+    abort();
+}
+
+} // namespace detail
+
+// A PerfectHashMap policy for null-terminated string keys, using
+// FastHashCharSequence. Lookups may use const char* or std::string.
+struct ConstStringHashPolicy {
+    static constexpr uint32_t hash(const char* key) {
+        return FastHashCharSequence(key, detail::ConstStrlen(key));
+    }
+    static uint32_t hash(const std::string& key) {
+        return FastHashCharSequence(key.c_str(), key.size());
+    }
+
+    static constexpr bool matches(const char* find, const char* key) {
+        for (size_t i = 0;; i++) {
+            if (find[i] != key[i])
+                return false;
+            if (!find[i])
+                return true;
+        }
+    }
+    static bool matches(const std::string& find, const char* key) {
+        return find.compare(key) == 0;
+    }
+};
+
+// A PerfectHashMap policy for integer keys, using HashInt32 or HashInt64.
+template <typename T>
+struct ConstIntegerHashPolicy {
+    static_assert(std::is_integral<T>::value || std::is_enum<T>::value,
+                  "ConstIntegerHashPolicy needs an integer or enum key");
+
+    static constexpr uint32_t hash(T key) {
+        return sizeof(T) <= 4 ? HashInt32(int32_t(key)) : HashInt64(int64_t(key));
+    }
+    static constexpr bool matches(T find, T key) {
+        return find == key;
+    }
+};
+
+namespace detail {
+
+template <typename K, bool IsString = std::is_same<K, const char*>::value>
+struct DefaultPerfectHashPolicy {
+    typedef ConstIntegerHashPolicy<K> type;
+};
+
+template <typename K>
+struct DefaultPerfectHashPolicy<K, true> {
+    typedef ConstStringHashPolicy type;
+};
+
+} // namespace detail
+
+// An immutable map over a fixed set of keys, whose hash table is built by
+// the compiler. Declare one constexpr with MakePerfectHashMap():
+//
+//     static constexpr auto kKeywords = MakePerfectHashMap<const char*, int>({
+//         {"if", 1},
+//         {"else", 2},
+//     });
+//
+// and it needs no initialization at runtime. Lookups hash the key once and
+// compare it against at most one entry.
+//
+// The table uses "hash and displace": the keys are split into buckets by
+// hash, and each bucket gets a seed such that a second hash of each key,
+// mixed with its bucket's seed, lands on a distinct slot. Buckets are placed
+// largest first, while the table is emptiest.
+//
+// HashPolicy has the same hash() and matches() functions as for HashMap,
+// except that they must be constexpr for K (and for any lookup type used in
+// a constant expression). Keys with the same 32-bit hash cannot be told
+// apart, and fail to compile with a call to PerfectHashKeysCollide().
+template <typename K, typename V, size_t N,
+          typename HashPolicy = typename detail::DefaultPerfectHashPolicy<K>::type>
+class PerfectHashMap
+{
+    static_assert(N > 0, "PerfectHashMap must have at least one key");
+
+  public:
+    typedef PerfectHashEntry<K, V> Entry;
+
+  private:
+    static const size_t kSlots = detail::PerfectHashSlots(N);
+    static const size_t kBuckets = N;
+    static const uint32_t kEmpty = UINT32_MAX;
+
+    // Every bucket should find a seed long before this, even the last,
+    // which has only one free slot to land in.
+    static const uint32_t kMaxSeed = uint32_t(64 * kSlots);
+
+  public:
+    constexpr explicit PerfectHashMap(const Entry (&entries)[N])
+     : PerfectHashMap(entries, std::make_index_sequence<N>())
+    {}
+
+    // Returns the entry for |key|, or null if there is none.
+    template <typename Lookup>
+    constexpr const Entry* find(const Lookup& key) const {
+        uint32_t hash = HashPolicy::hash(key);
+        uint32_t index = slots_[slotOf(hash, seeds_[bucketOf(hash)])];
+        if (index == kEmpty || !HashPolicy::matches(key, entries_[index].key))
+            return nullptr;
+        return &entries_[index];
+    }
+
+    template <typename Lookup>
+    constexpr bool contains(const Lookup& key) const {
+        return !!find(key);
+    }
+
+    constexpr size_t elements() const {
+        return N;
+    }
+
+    // Entries are visited in the order they were given.
+    constexpr const Entry* begin() const {
+        return &entries_[0];
+    }
+    constexpr const Entry* end() const {
+        return &entries_[N];
+    }
+
+  private:
+    template <size_t... I>
+    constexpr PerfectHashMap(const Entry (&entries)[N], std::index_sequence<I...>)
+     : entries_{entries[I]...},
+       seeds_(),
+       slots_()
+    {
+        build();
+    }
+
+    static constexpr uint32_t bucketOf(uint32_t hash) {
+        return uint32_t((uint64_t(hash * 0x9E3779B9u) * kBuckets) >> 32);
+    }
+
+    // A full 64-bit mix (the SplitMix64 finalizer), so that every bit of
+    // the hash and the seed affects the slot.
+    static constexpr uint32_t slotOf(uint32_t hash, uint32_t seed) {
+        uint64_t x = (uint64_t(hash) << 32) | seed;
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ull;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebull;
+        x ^= x >> 31;
+        return uint32_t(x) & uint32_t(kSlots - 1);
+    }
+
+    constexpr void build() {
+        uint32_t hashes[N] = {};
+        for (size_t i = 0; i < N; i++)
+            hashes[i] = HashPolicy::hash(entries_[i].key);
+
+        // Sort the keys by bucket.
+        size_t starts[kBuckets + 1] = {};
+        for (size_t i = 0; i < N; i++)
+            starts[bucketOf(hashes[i]) + 1]++;
+        size_t largest = 0;
+        for (size_t b = 0; b < kBuckets; b++) {
+            if (starts[b + 1] > largest)
+                largest = starts[b + 1];
+            starts[b + 1] += starts[b];
+        }
+        size_t members[N] = {};
+        size_t filled[kBuckets] = {};
+        for (size_t i = 0; i < N; i++) {
+            uint32_t b = bucketOf(hashes[i]);
+            members[starts[b] + filled[b]++] = i;
+        }
+
+        for (size_t i = 0; i < kSlots; i++)
+            slots_[i] = kEmpty;
+
+        for (size_t size = largest; size > 0; size--) {
+            for (size_t b = 0; b < kBuckets; b++) {
+                if (starts[b + 1] - starts[b] == size)
+                    seeds_[b] = place(hashes, &members[starts[b]], size);
+            }
+        }
+    }
+
+    // Find a seed that puts each of |count| keys in its own free slot, and
+    // claim the slots.
+    constexpr uint32_t place(const uint32_t* hashes, const size_t* keys, size_t count) {
+        for (uint32_t seed = 0; seed < kMaxSeed; seed++) {
+            bool fits = true;
+            for (size_t i = 0; fits && i < count; i++) {
+                uint32_t slot = slotOf(hashes[keys[i]], seed);
+                if (slots_[slot] != kEmpty)
+                    fits = false;
+                for (size_t j = 0; fits && j < i; j++) {
+                    if (slotOf(hashes[keys[j]], seed) == slot)
+                        fits = false;
+                }
+            }
+            if (!fits)
+                continue;
+
+            for (size_t i = 0; i < count; i++)
+                slots_[slotOf(hashes[keys[i]], seed)] = uint32_t(keys[i]);
+            return seed;
+        }
+
+        detail::PerfectHashKeysCollide();
+        return 0;
+    }
+
+  private:
+    Entry entries_[N];
+    uint32_t seeds_[kBuckets];
+    uint32_t slots_[kSlots];
+};
+
+// Build a PerfectHashMap from a braced list of {key, value} pairs. K and V
+// must be given explicitly; N is deduced.
+template <typename K, typename V,
+          typename HashPolicy = typename detail::DefaultPerfectHashPolicy<K>::type, size_t N>
+constexpr PerfectHashMap<K, V, N, HashPolicy>
+MakePerfectHashMap(const PerfectHashEntry<K, V> (&entries)[N])
+{
+    return PerfectHashMap<K, V, N, HashPolicy>(entries);
+}
+
+} // namespace ke
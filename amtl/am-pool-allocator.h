@@ -0,0 +1,444 @@
+// vim: set sts=8 ts=4 sw=4 tw=99 et:
+//
+// Copyright (C) 2026 David Anderson and AlliedModders LLC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of AlliedModders LLC nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <cstddef>
+#include <mutex>
+#include <new>
+
+#include <amtl/am-allocator-policies.h>
+#include <amtl/am-bits.h>
+#include <amtl/am-threadlocal.h>
+
+namespace ke {
+
+namespace detail {
+
+// Small requests are rounded up to one of kPoolSizeClasses sizes: multiples
+// of 16 up to 128 bytes, then four classes per power of two up to 32KB. No
+// class wastes more than a quarter of its block.
+static const uint32_t kPoolSizeClasses = 40;
+static const size_t kPoolMaxSmallSize = 32 * 1024;
+
+static inline uint32_t
+PoolSizeClass(size_t bytes)
+{
+    assert(bytes && bytes <= kPoolMaxSmallSize);
+    if (bytes <= 128)
+        return uint32_t((bytes - 1) / 16);
+    uint32_t lg = FindLeftmostBit32(uint32_t(bytes - 1));
+    return 4 + (lg - 7) * 4 + uint32_t((bytes - 1) >> (lg - 2));
+}
+
+static inline size_t
+PoolClassSize(uint32_t sizeClass)
+{
+    assert(sizeClass < kPoolSizeClasses);
+    if (sizeClass < 8)
+        return (sizeClass + 1) * 16;
+    uint32_t group = (sizeClass - 8) / 4;
+    return (size_t(128) << group) + ((sizeClass - 8) % 4 + 1) * (size_t(32) << group);
+}
+
+} // namespace detail
+
+// A thread-safe allocator for many small, short-lived allocations made by
+// several threads at once.
+//
+// Small requests are served from per-thread caches of free blocks, one list
+// per size class, with no locking. A cache that runs dry takes a batch of
+// blocks from a central list for that size class; a cache that holds too
+// many gives a batch back, so the lock is taken once per batch rather than
+// once per allocation, and blocks freed by one thread can be reused by
+// another. Central lists are refilled by carving spans from AllocPolicy,
+// which are only returned when the pool is destroyed. Requests over 32KB
+// go straight to AllocPolicy.
+//
+// Blocks carry no header: deallocate() is given the size that was
+// allocated, which picks the size class, so a block costs only its class
+// size. Blocks are aligned as well as AllocPolicy's own allocations, up to
+// 16 bytes.
+//
+// Each pool uses one thread-local storage slot, so pools should be few and
+// long-lived. A thread that is finished with a pool should call
+// flushThreadCache(), otherwise the blocks it cached are unusable until the
+// pool is destroyed. The pool must outlive everything allocated from it.
+template <typename AllocPolicy = SystemAllocatorPolicy>
+class Pool : private AllocPolicy
+{
+    // Free blocks are linked through their payload. The first block of a
+    // batch also links to the next batch.
+    struct FreeBlock {
+        FreeBlock* next;
+        FreeBlock* nextBatch;
+    };
+
+    struct FreeList {
+        FreeBlock* head;
+        uint32_t count;
+    };
+
+    struct ThreadCache {
+        FreeList lists[detail::kPoolSizeClasses];
+        ThreadCache* next;
+    };
+
+    // Whole batches, plus blocks given back one at a time that have not yet
+    // made up a batch.
+    struct CentralList {
+        std::mutex lock;
+        FreeBlock* batches;
+        FreeBlock* loose;
+        uint32_t nloose;
+    };
+
+    struct Span {
+        Span* next;
+        size_t bytes;
+    };
+
+    // Spans keep a header, rounded up so that blocks stay 16-byte aligned.
+    static const size_t kSpanHeaderBytes = 16;
+    static const size_t kSpanBytes = 64 * 1024;
+
+    static_assert(sizeof(Span) <= kSpanHeaderBytes, "span header must fit");
+    static_assert(sizeof(FreeBlock) <= 16, "free block must fit the smallest class");
+
+  public:
+    explicit Pool(AllocPolicy ap = AllocPolicy())
+     : AllocPolicy(ap),
+       spans_(nullptr),
+       caches_(nullptr),
+       bytes_(0)
+    {
+        if (!cache_.allocate()) {
+            fprintf(stderr, "could not allocate thread-local storage\n");
+            abort();
+        }
+        for (uint32_t i = 0; i < detail::kPoolSizeClasses; i++) {
+            // Aim for 16KB per batch, within limits.
+            size_t batch = (16 * 1024) / detail::PoolClassSize(i);
+            batch_[i] = uint32_t(batch < 2 ? 2 : (batch > 32 ? 32 : batch));
+            central_[i].batches = nullptr;
+            central_[i].loose = nullptr;
+            central_[i].nloose = 0;
+        }
+    }
+
+    ~Pool() {
+        while (caches_) {
+            ThreadCache* next = caches_->next;
+            this->am_free(caches_);
+            caches_ = next;
+        }
+        while (spans_) {
+            Span* next = spans_->next;
+            this->am_free(spans_);
+            spans_ = next;
+        }
+    }
+
+    // Returns null if out of memory.
+    void* allocate(size_t bytes) {
+        if (bytes > detail::kPoolMaxSmallSize)
+            return allocateLarge(bytes);
+
+        uint32_t sizeClass = detail::PoolSizeClass(bytes ? bytes : 1);
+        ThreadCache* cache = threadCache();
+        if (!cache)
+            return nullptr;
+
+        FreeList& list = cache->lists[sizeClass];
+        if (!list.head && !fetchBatch(sizeClass, &list))
+            return nullptr;
+
+        FreeBlock* block = list.head;
+        list.head = block->next;
+        list.count--;
+        return block;
+    }
+
+    // |ptr| may have been allocated by any thread. |bytes| must be the size
+    // it was allocated with.
+    void deallocate(void* ptr, size_t bytes) {
+        if (!ptr)
+            return;
+
+        if (bytes > detail::kPoolMaxSmallSize) {
+            std::lock_guard<std::mutex> lock(lock_);
+            bytes_ -= bytes;
+            this->am_free(ptr);
+            return;
+        }
+
+        uint32_t sizeClass = detail::PoolSizeClass(bytes ? bytes : 1);
+        FreeBlock* block = reinterpret_cast<FreeBlock*>(ptr);
+        ThreadCache* cache = threadCache();
+        if (!cache) {
+            CentralList& central = central_[sizeClass];
+            std::lock_guard<std::mutex> lock(central.lock);
+            addLoose(sizeClass, &central, block);
+            return;
+        }
+
+        FreeList& list = cache->lists[sizeClass];
+        block->next = list.head;
+        list.head = block;
+        if (++list.count >= 2 * batch_[sizeClass])
+            releaseBatch(sizeClass, &list);
+    }
+
+    // Give the calling thread's cached blocks back to the pool, and free its
+    // cache. The thread may keep using the pool afterward.
+    void flushThreadCache() {
+        ThreadCache* cache = cache_.get();
+        if (!cache)
+            return;
+
+        for (uint32_t i = 0; i < detail::kPoolSizeClasses; i++) {
+            FreeList& list = cache->lists[i];
+            while (list.count >= batch_[i])
+                releaseBatch(i, &list);
+
+            CentralList& central = central_[i];
+            std::lock_guard<std::mutex> lock(central.lock);
+            while (list.head) {
+                FreeBlock* block = list.head;
+                list.head = block->next;
+                addLoose(i, &central, block);
+            }
+        }
+
+        cache_ = nullptr;
+
+        std::lock_guard<std::mutex> lock(lock_);
+        for (ThreadCache** p = &caches_; *p; p = &(*p)->next) {
+            if (*p == cache) {
+                *p = cache->next;
+                break;
+            }
+        }
+        bytes_ -= sizeof(ThreadCache);
+        this->am_free(cache);
+    }
+
+    // Bytes taken from AllocPolicy, whether handed out or not.
+    size_t memoryUse() {
+        std::lock_guard<std::mutex> lock(lock_);
+        return bytes_;
+    }
+
+  private:
+    void* allocateLarge(size_t bytes) {
+        std::lock_guard<std::mutex> lock(lock_);
+        void* ptr = this->am_malloc(bytes);
+        if (!ptr)
+            return nullptr;
+        bytes_ += bytes;
+        return ptr;
+    }
+
+    ThreadCache* threadCache() {
+        ThreadCache* cache = cache_.get();
+        if (cache)
+            return cache;
+
+        std::lock_guard<std::mutex> lock(lock_);
+        cache = (ThreadCache*)this->am_malloc(sizeof(ThreadCache));
+        if (!cache)
+            return nullptr;
+        new (cache) ThreadCache();
+        cache->next = caches_;
+        caches_ = cache;
+        bytes_ += sizeof(ThreadCache);
+        cache_ = cache;
+        return cache;
+    }
+
+    // Refill an empty thread cache list from the central list.
+    bool fetchBatch(uint32_t sizeClass, FreeList* list) {
+        assert(!list->head);
+
+        CentralList& central = central_[sizeClass];
+        std::lock_guard<std::mutex> lock(central.lock);
+        if (!central.batches && !central.loose && !carveSpan(sizeClass, &central))
+            return false;
+
+        if (central.batches) {
+            list->head = central.batches;
+            list->count = batch_[sizeClass];
+            central.batches = central.batches->nextBatch;
+        } else {
+            list->head = central.loose;
+            list->count = central.nloose;
+            central.loose = nullptr;
+            central.nloose = 0;
+        }
+        return true;
+    }
+
+    // Move one batch from the front of a thread cache list to the central
+    // list.
+    void releaseBatch(uint32_t sizeClass, FreeList* list) {
+        uint32_t count = batch_[sizeClass];
+        assert(list->count >= count);
+
+        FreeBlock* first = list->head;
+        FreeBlock* last = first;
+        for (uint32_t i = 1; i < count; i++)
+            last = last->next;
+        list->head = last->next;
+        list->count -= count;
+        last->next = nullptr;
+
+        CentralList& central = central_[sizeClass];
+        std::lock_guard<std::mutex> lock(central.lock);
+        first->nextBatch = central.batches;
+        central.batches = first;
+    }
+
+    // The central list's lock must be held.
+    void addLoose(uint32_t sizeClass, CentralList* central, FreeBlock* block) {
+        block->next = central->loose;
+        central->loose = block;
+        if (++central->nloose < batch_[sizeClass])
+            return;
+        block->nextBatch = central->batches;
+        central->batches = block;
+        central->loose = nullptr;
+        central->nloose = 0;
+    }
+
+    // Allocate a span and split it into whole batches of blocks. The central
+    // list's lock must be held.
+    bool carveSpan(uint32_t sizeClass, CentralList* central) {
+        size_t blockBytes = detail::PoolClassSize(sizeClass);
+        size_t batchBytes = blockBytes * batch_[sizeClass];
+        size_t nbatches = (kSpanBytes - kSpanHeaderBytes) / batchBytes;
+        if (!nbatches)
+            nbatches = 1;
+        size_t bytes = kSpanHeaderBytes + nbatches * batchBytes;
+
+        Span* span;
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            span = (Span*)this->am_malloc(bytes);
+            if (!span)
+                return false;
+            span->next = spans_;
+            span->bytes = bytes;
+            spans_ = span;
+            bytes_ += bytes;
+        }
+
+        char* cursor = reinterpret_cast<char*>(span) + kSpanHeaderBytes;
+        for (size_t i = 0; i < nbatches; i++) {
+            FreeBlock* first = nullptr;
+            for (uint32_t j = 0; j < batch_[sizeClass]; j++) {
+                FreeBlock* block = reinterpret_cast<FreeBlock*>(cursor);
+                block->next = first;
+                first = block;
+                cursor += blockBytes;
+            }
+            first->nextBatch = central->batches;
+            central->batches = first;
+        }
+        return true;
+    }
+
+  private:
+    Pool(const Pool& other) = delete;
+    Pool& operator =(const Pool& other) = delete;
+
+  private:
+    ThreadLocal<ThreadCache*> cache_;
+    uint32_t batch_[detail::kPoolSizeClasses];
+    CentralList central_[detail::kPoolSizeClasses];
+
+    // Guards everything below, and calls into AllocPolicy.
+    std::mutex lock_;
+    Span* spans_;
+    ThreadCache* caches_;
+    size_t bytes_;
+};
+
+// An allocator policy that takes memory from a Pool. Any number of
+// containers on any number of threads can share one pool; each container
+// still needs its own synchronization.
+//
+// The pool needs the size of each block it frees, so this only has the
+// sized am_free(), and suits containers that allocate through
+// AllocPolicyTraits.
+class PoolAllocatorPolicy
+{
+  public:
+    explicit PoolAllocatorPolicy(Pool<>* pool)
+     : pool_(pool)
+    {}
+
+    void reportOutOfMemory() {
+        fprintf(stderr, "OUT OF MEMORY\n");
+        abort();
+    }
+    void reportAllocationOverflow() {
+        fprintf(stderr, "OUT OF MEMORY\n");
+        abort();
+    }
+
+    void am_free(void* memory, size_t bytes) {
+        pool_->deallocate(memory, bytes);
+    }
+    void* am_malloc(size_t bytes) {
+        return pool_->allocate(bytes);
+    }
+
+    Pool<>* pool() const {
+        return pool_;
+    }
+
+    bool operator ==(const PoolAllocatorPolicy& other) const {
+        return pool_ == other.pool_;
+    }
+    bool operator !=(const PoolAllocatorPolicy& other) const {
+        return pool_ != other.pool_;
+    }
+
+  private:
+    Pool<>* pool_;
+};
+
+} // namespace ke
@@ -34,6 +34,7 @@
 
 #include <algorithm>
 #include <functional>
+#include <memory>
 #include <utility>
 #include <vector>
 
@@ -46,12 +47,17 @@ namespace ke {
 // return whether the left value should be dequeued before the right.
 //
 // This allows move-and-pop which the STL container does not.
-template <typename T, typename IsHigherPriority = std::less<T>>
+//
+// The vector's memory comes from Allocator, for example a StdAllocator.
+template <typename T, typename IsHigherPriority = std::less<T>,
+          typename Allocator = std::allocator<T>>
 class PriorityQueue final
 {
   public:
-    explicit PriorityQueue(IsHigherPriority hp = IsHigherPriority())
-       : is_higher_priority_(hp)
+    explicit PriorityQueue(IsHigherPriority hp = IsHigherPriority(),
+                           const Allocator& alloc = Allocator())
+       : impl_(alloc),
+         is_higher_priority_(hp)
     {}
 
     PriorityQueue(PriorityQueue&& other)
@@ -159,7 +165,7 @@ class PriorityQueue final
     void operator =(const PriorityQueue& other) = delete;
 
   private:
-    std::vector<T> impl_;
+    std::vector<T, Allocator> impl_;
     IsHigherPriority is_higher_priority_;
 };
 
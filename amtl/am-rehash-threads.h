@@ -0,0 +1,121 @@
+// vim: set sts=8 ts=4 sw=4 tw=99 et:
+//
+// Copyright (C) 2026 David Anderson and AlliedModders LLC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of AlliedModders LLC nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <amtl/am-platform.h>
+
+#if defined(KE_POSIX)
+# include <pthread.h>
+#elif defined(KE_WINDOWS)
+# include <Windows.h>
+#endif
+
+namespace ke {
+
+// RehashWorkers for a HashTable with kRehashThreads > 1, which runs every
+// worker but the first on a thread of its own. Threads are started through
+// the OS rather than std::thread, so that failing to start one is noticed
+// instead of aborting the process: that worker runs on the calling thread
+// once the others have started, and the resize still completes.
+struct RehashThreads
+{
+    static const uint32_t kMaxThreads = 64;
+
+    template <typename Fn>
+    static void run(uint32_t count, Fn& fn) {
+        assert(count <= kMaxThreads);
+
+        Worker<Fn> workers[kMaxThreads];
+        bool started[kMaxThreads];
+        for (uint32_t i = 1; i < count; i++) {
+            workers[i].fn = &fn;
+            workers[i].index = i;
+            started[i] = workers[i].start();
+        }
+
+        fn(0);
+        for (uint32_t i = 1; i < count; i++) {
+            if (started[i])
+                workers[i].join();
+            else
+                fn(i);
+        }
+    }
+
+  private:
+    template <typename Fn>
+    struct Worker {
+        Fn* fn;
+        uint32_t index;
+
+#if defined(KE_POSIX)
+        pthread_t thread;
+
+        bool start() {
+            return pthread_create(&thread, nullptr, &Main, this) == 0;
+        }
+        void join() {
+            pthread_join(thread, nullptr);
+        }
+        static void* Main(void* arg) {
+            Worker* worker = reinterpret_cast<Worker*>(arg);
+            (*worker->fn)(worker->index);
+            return nullptr;
+        }
+#elif defined(KE_WINDOWS)
+        HANDLE thread;
+
+        bool start() {
+            thread = CreateThread(nullptr, 0, &Main, this, 0, nullptr);
+            return thread != nullptr;
+        }
+        void join() {
+            WaitForSingleObject(thread, INFINITE);
+            CloseHandle(thread);
+        }
+        static DWORD WINAPI Main(LPVOID arg) {
+            Worker* worker = reinterpret_cast<Worker*>(arg);
+            (*worker->fn)(worker->index);
+            return 0;
+        }
+#else
+        bool start() {
+            return false;
+        }
+        void join() {
+        }
+#endif
+    };
+};
+
+} // namespace ke
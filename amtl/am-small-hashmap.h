@@ -0,0 +1,389 @@
+// vim: set sts=8 ts=4 sw=4 tw=99 et:
+//
+// Copyright (C) 2026 David Anderson and AlliedModders LLC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of AlliedModders LLC nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <new>
+#include <utility>
+
+#include <amtl/am-hashtable.h>
+#include <amtl/am-maybe.h>
+#include <amtl/am-storagebuffer.h>
+
+namespace ke {
+
+// A map that holds up to N entries inside the object itself, searching them
+// linearly, and only moves them into a heap-allocated HashTable once it grows
+// past N. This avoids an allocation entirely for maps that stay small, and
+// for small N a linear scan is as fast as hashing.
+//
+// The API matches HashMap, except that init() is not needed, and that Result
+// and Insert are invalidated by any mutation (including the one that spills
+// to the heap). Once spilled, the map stays on the heap, even if entries are
+// removed or it is cleared.
+//
+// The template parameters are the same as for HashMap, plus N, the number of
+// entries stored inline.
+template <typename K, typename V, typename HashPolicy, size_t N = 8,
+          typename AllocPolicy = SystemAllocatorPolicy>
+class SmallHashMap
+{
+    static_assert(N > 0, "SmallHashMap must have at least one inline entry");
+
+  public:
+    struct Entry {
+        K key;
+        V value;
+
+        Entry(Entry&& other)
+         : key(std::move(other.key)),
+           value(std::move(other.value))
+        {}
+
+        template <typename UK, typename UV>
+        Entry(UK&& aKey, UV&& aValue)
+         : key(std::forward<UK>(aKey)),
+           value(std::forward<UV>(aValue))
+        {}
+    };
+
+  private:
+    struct Policy : public detail::HashPolicyOptions<HashPolicy> {
+        typedef Entry Payload;
+
+        template <typename Lookup>
+        static auto hash(const Lookup& key) -> decltype(HashPolicy::hash(key)) {
+            return HashPolicy::hash(key);
+        }
+
+        template <typename Lookup>
+        static bool matches(const Lookup& key, const Payload& payload) {
+            return HashPolicy::matches(key, payload.key);
+        }
+    };
+
+    typedef HashTable<Policy, AllocPolicy> Table;
+
+  public:
+    explicit SmallHashMap(AllocPolicy ap = AllocPolicy())
+     : table_(ap),
+       ninline_(0),
+       spilled_(false)
+    {}
+
+    SmallHashMap(SmallHashMap&& other)
+     : table_(std::move(other.table_)),
+       ninline_(0),
+       spilled_(other.spilled_)
+    {
+        for (size_t i = 0; i < other.ninline_; i++)
+            new (inlineAt(i)) Entry(std::move(*other.inlineAt(i)));
+        ninline_ = other.ninline_;
+        other.clearInline();
+        other.spilled_ = false;
+    }
+
+    ~SmallHashMap() {
+        clearInline();
+    }
+
+    class Result
+    {
+        friend class SmallHashMap;
+
+        Entry* entry_;
+        Maybe<typename Table::Result> table_;
+
+      public:
+        Result()
+         : entry_(nullptr)
+        {}
+
+        Entry* operator ->() {
+            return entry_;
+        }
+        Entry& operator *() {
+            return *entry_;
+        }
+
+        bool found() const {
+            return !!entry_;
+        }
+    };
+
+    class Insert
+    {
+        friend class SmallHashMap;
+
+        Entry* entry_;
+        Maybe<typename Table::Insert> table_;
+
+      public:
+        Insert()
+         : entry_(nullptr)
+        {}
+
+        Entry* operator ->() {
+            return entry_;
+        }
+        Entry& operator *() {
+            return *entry_;
+        }
+
+        bool found() const {
+            return !!entry_;
+        }
+    };
+
+    template <typename Lookup>
+    Result find(const Lookup& key) const {
+        Result r;
+        if (spilled_) {
+            typename Table::Result tr = table_.find(key);
+            if (tr.found())
+                r.entry_ = &*tr;
+            r.table_.init(tr);
+        } else {
+            r.entry_ = findInline(key);
+        }
+        return r;
+    }
+
+    template <typename Lookup>
+    Insert findForAdd(const Lookup& key) {
+        Insert i;
+        if (spilled_) {
+            typename Table::Insert ti = table_.findForAdd(key);
+            if (ti.found())
+                i.entry_ = &*ti;
+            i.table_.init(ti);
+        } else {
+            i.entry_ = findInline(key);
+        }
+        return i;
+    }
+
+    // The map must not have been mutated in between findForAdd() and add().
+    // The Insert object is still valid after add() returns, however.
+    template <typename UK, typename UV>
+    bool add(Insert& i, UK&& key, UV&& value) {
+        assert(!i.found());
+
+        if (!spilled_ && ninline_ < N) {
+            i.entry_ = new (inlineAt(ninline_)) Entry(std::forward<UK>(key),
+                                                      std::forward<UV>(value));
+            ninline_++;
+            return true;
+        }
+
+        if (!spilled_) {
+            if (!spill())
+                return false;
+            i.table_.init(table_.findForAdd(key));
+        }
+
+        typename Table::Insert& ti = i.table_.get();
+        if (!table_.add(ti, Entry(std::forward<UK>(key), std::forward<UV>(value))))
+            return false;
+        i.entry_ = &*ti;
+        return true;
+    }
+    template <typename UK>
+    bool add(Insert& i, UK&& key) {
+        return add(i, std::forward<UK>(key), V());
+    }
+
+    template <typename Lookup>
+    void removeIfExists(const Lookup& key) {
+        Result r = find(key);
+        if (!r.found())
+            return;
+        remove(r);
+    }
+
+    void remove(Result& r) {
+        assert(r.found());
+        if (spilled_)
+            table_.remove(r.table_.get());
+        else
+            removeInline(size_t(r.entry_ - inlineAt(0)));
+        r.entry_ = nullptr;
+    }
+
+    void clear() {
+        if (spilled_)
+            table_.clear();
+        clearInline();
+    }
+
+    size_t elements() const {
+        return spilled_ ? table_.elements() : ninline_;
+    }
+
+    // Heap memory only; entries stored inline are part of the object.
+    size_t estimateMemoryUse() const {
+        return spilled_ ? table_.estimateMemoryUse() : 0;
+    }
+
+    bool spilled() const {
+        return spilled_;
+    }
+
+    AllocPolicy& allocPolicy() {
+        return table_.allocPolicy();
+    }
+
+    // It is illegal to mutate the map during iteration, other than through
+    // erase().
+    class iterator
+    {
+      public:
+        explicit iterator(SmallHashMap* map)
+         : map_(map),
+           i_(0),
+           revisit_(false)
+        {
+            if (map_->spilled_)
+                table_.init(&map_->table_);
+        }
+
+        bool empty() const {
+            if (table_.isValid())
+                return table_.get().empty();
+            return i_ >= map_->ninline_;
+        }
+
+        void erase() {
+            assert(!empty());
+            if (table_.isValid()) {
+                table_.get().erase();
+                return;
+            }
+
+            // The last entry moves into this slot, so it must be visited next.
+            map_->removeInline(i_);
+            revisit_ = true;
+        }
+
+        Entry* operator ->() const {
+            return &**this;
+        }
+        Entry& operator *() const {
+            if (table_.isValid())
+                return *table_.get();
+            return *map_->inlineAt(i_);
+        }
+
+        void next() {
+            if (table_.isValid()) {
+                table_.get().next();
+                return;
+            }
+            if (revisit_)
+                revisit_ = false;
+            else
+                i_++;
+        }
+
+      private:
+        SmallHashMap* map_;
+        Maybe<typename Table::iterator> table_;
+        size_t i_;
+        bool revisit_;
+    };
+
+    iterator iter() {
+        return iterator(this);
+    }
+
+  private:
+    Entry* inlineAt(size_t index) {
+        return inline_[index].address();
+    }
+    const Entry* inlineAt(size_t index) const {
+        return inline_[index].address();
+    }
+
+    template <typename Lookup>
+    Entry* findInline(const Lookup& key) const {
+        for (size_t i = 0; i < ninline_; i++) {
+            if (HashPolicy::matches(key, inlineAt(i)->key))
+                return const_cast<Entry*>(inlineAt(i));
+        }
+        return nullptr;
+    }
+
+    // Order is not preserved: the last entry fills the hole.
+    void removeInline(size_t index) {
+        assert(index < ninline_);
+        size_t last = ninline_ - 1;
+        inlineAt(index)->~Entry();
+        if (index != last) {
+            new (inlineAt(index)) Entry(std::move(*inlineAt(last)));
+            inlineAt(last)->~Entry();
+        }
+        ninline_--;
+    }
+
+    void clearInline() {
+        for (size_t i = 0; i < ninline_; i++)
+            inlineAt(i)->~Entry();
+        ninline_ = 0;
+    }
+
+    // Move the inline entries into the heap table, leaving room to grow.
+    bool spill() {
+        if (!table_.reserve(N * 2))
+            return false;
+        for (size_t i = 0; i < ninline_; i++) {
+            Entry* entry = inlineAt(i);
+            typename Table::Insert p = table_.findForAdd(entry->key);
+            if (!table_.add(p, std::move(*entry)))
+                return false;
+        }
+        clearInline();
+        spilled_ = true;
+        return true;
+    }
+
+  private:
+    SmallHashMap(const SmallHashMap& other) = delete;
+    SmallHashMap& operator =(const SmallHashMap& other) = delete;
+
+  private:
+    Table table_;
+    size_t ninline_;
+    bool spilled_;
+    StorageBuffer<Entry> inline_[N];
+};
+
+} // namespace ke
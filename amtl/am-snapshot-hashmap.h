@@ -0,0 +1,226 @@
+// vim: set sts=8 ts=4 sw=4 tw=99 et:
+//
+// Copyright (C) 2026 David Anderson and AlliedModders LLC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of AlliedModders LLC nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+
+#include <mutex>
+#include <utility>
+
+#include <amtl/am-hashmap.h>
+#include <amtl/am-mutex.h>
+#include <amtl/am-refcounting-threadsafe.h>
+
+namespace ke {
+
+// A HashMap for tables that are read often from many threads, and changed
+// rarely. Readers look up keys in an immutable snapshot of the map, taking no
+// locks beyond the brief one AtomicRef uses to add a reference to it. Writers
+// are serialized; each change copies the current snapshot, modifies the copy,
+// and publishes it. Old snapshots are freed once the last reader holding one
+// drops its reference.
+//
+// Every change costs a full copy, so several changes should be batched with
+// update() where possible. K and V must be copy-constructible.
+//
+// The template parameters are the same as for HashMap.
+template <typename K, typename V, typename HashPolicy, typename AllocPolicy = SystemAllocatorPolicy>
+class SnapshotHashMap
+{
+  public:
+    typedef HashMap<K, V, HashPolicy, AllocPolicy> Map;
+
+    // A published, read-only version of the map. Holding a reference keeps
+    // it alive, and it will never change, no matter what writers do.
+    class Snapshot : public RefcountedThreadsafe<Snapshot>
+    {
+        friend class SnapshotHashMap;
+
+      public:
+        explicit Snapshot(AllocPolicy ap)
+         : map_(ap)
+        {}
+
+        // The result must not be used to modify the entry.
+        template <typename Lookup>
+        typename Map::Result find(const Lookup& key) const {
+            return map_.find(key);
+        }
+
+        template <typename Lookup>
+        bool contains(const Lookup& key) const {
+            return map_.find(key).found();
+        }
+
+        size_t elements() const {
+            return map_.elements();
+        }
+
+        // Call |fn(key, value)| for every entry.
+        template <typename Fn>
+        void forEach(Fn fn) const {
+            for (auto iter = map_.iter(); !iter.empty(); iter.next()) {
+                const K& key = iter->key;
+                const V& value = iter->value;
+                fn(key, value);
+            }
+        }
+
+      private:
+        // Copy |other| into this snapshot, leaving room for |extra| more
+        // entries.
+        bool copy(Snapshot* other, size_t extra) {
+            if (!map_.reserve(other->map_.elements() + extra))
+                return false;
+            for (auto iter = other->map_.iter(); !iter.empty(); iter.next()) {
+                auto i = map_.findForAdd(iter->key);
+                if (!map_.add(i, iter->key, iter->value))
+                    return false;
+            }
+            return true;
+        }
+
+        // Once published, the map must not change. Any incremental resize
+        // left over from the writer is finished here, since starting an
+        // iterator completes it.
+        void seal() {
+            map_.iter();
+        }
+
+      private:
+        mutable Map map_;
+    };
+
+    explicit SnapshotHashMap(AllocPolicy ap = AllocPolicy())
+     : ap_(ap)
+    {}
+
+    // capacity must be a power of two.
+    bool init(size_t capacity = 16) {
+        RefPtr<Snapshot> first = new Snapshot(ap_);
+        if (!first->map_.init(capacity))
+            return false;
+        current_ = first;
+        return true;
+    }
+
+    // Get the current snapshot. This never blocks on writers.
+    RefPtr<Snapshot> snapshot() const {
+        return current_.get();
+    }
+
+    // Copy the value for |key| into |out|, returning false if there is none.
+    template <typename Lookup>
+    bool get(const Lookup& key, V* out) const {
+        RefPtr<Snapshot> snap = snapshot();
+        auto r = snap->find(key);
+        if (!r.found())
+            return false;
+        *out = r->value;
+        return true;
+    }
+
+    template <typename Lookup>
+    bool contains(const Lookup& key) const {
+        return snapshot()->contains(key);
+    }
+
+    size_t elements() const {
+        return snapshot()->elements();
+    }
+
+    // Call |fn(map)| on a private copy of the map, then publish the copy.
+    // |fn| may make any number of changes, and returns false to abandon them.
+    // Returns false if |fn| did, or if the copy could not be made.
+    template <typename Fn>
+    bool update(Fn fn, size_t extra = 1) {
+        std::lock_guard<Mutex> lock(write_lock_);
+
+        RefPtr<Snapshot> prev = current_.get();
+        RefPtr<Snapshot> next = new Snapshot(ap_);
+        if (!next->copy(prev, extra))
+            return false;
+        if (!fn(next->map_))
+            return false;
+        next->seal();
+
+        current_ = next;
+        return true;
+    }
+
+    // Add |key|, or replace its value if it is already present.
+    template <typename UK, typename UV>
+    bool set(UK&& key, UV&& value) {
+        return update([&](Map& map) -> bool {
+            auto i = map.findForAdd(key);
+            if (i.found()) {
+                i->value = std::forward<UV>(value);
+                return true;
+            }
+            return map.add(i, std::forward<UK>(key), std::forward<UV>(value));
+        });
+    }
+
+    // Returns false if |key| was not present, in which case no new snapshot
+    // is published.
+    template <typename Lookup>
+    bool remove(const Lookup& key) {
+        if (!contains(key))
+            return false;
+        return update([&](Map& map) -> bool {
+            auto r = map.find(key);
+            if (!r.found())
+                return false;
+            map.remove(r);
+            return true;
+        }, 0);
+    }
+
+    void clear() {
+        std::lock_guard<Mutex> lock(write_lock_);
+
+        RefPtr<Snapshot> next = new Snapshot(ap_);
+        if (!next->map_.init())
+            return;
+        current_ = next;
+    }
+
+  private:
+    SnapshotHashMap(const SnapshotHashMap& other) = delete;
+    SnapshotHashMap& operator =(const SnapshotHashMap& other) = delete;
+
+  private:
+    AllocPolicy ap_;
+    Mutex write_lock_;
+    mutable AtomicRef<Snapshot> current_;
+};
+
+} // namespace ke
@@ -61,6 +61,16 @@ MemsetZero(T* t) {
 #    define KE_CRITICAL_LIKELY(x) x
 #endif
 
+// Hint that |addr| will be read soon. This is a no-op where unsupported.
+#if defined(__GNUC__)
+#    define KE_PREFETCH(addr) __builtin_prefetch(addr)
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#    include <xmmintrin.h>
+#    define KE_PREFETCH(addr) _mm_prefetch(reinterpret_cast<const char*>(addr), _MM_HINT_T0)
+#else
+#    define KE_PREFETCH(addr) ((void)(addr))
+#endif
+
 template <typename T>
 struct cast_to_pointer {
     static void* cast(const T& t) {
@@ -69,8 +69,8 @@ static inline void InsertAt(std::vector<T, A>* vec, size_t at, T&& item) {
     vec->insert(vec->begin() + at, std::forward<T>(item));
 }
 
-template <typename T, typename... Args>
-static inline void EmplaceAt(std::vector<T>* vec, size_t at, Args&&... item) {
+template <typename T, typename A, typename... Args>
+static inline void EmplaceAt(std::vector<T, A>* vec, size_t at, Args&&... item) {
     vec->emplace(vec->begin() + at, std::forward<Args>(item)...);
 }
 
@@ -0,0 +1,362 @@
+// vim: set sts=8 ts=2 sw=2 tw=99 et:
+//
+// Copyright (C) 2013, David Anderson and AlliedModders LLC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of AlliedModders LLC nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <map>
+#include <string>
+
+#include <amtl/am-allocator-policies.h>
+#include <amtl/am-bloom-filter.h>
+#include <amtl/am-fixedarray.h>
+#include <amtl/am-hashmap.h>
+#include <amtl/am-ordered-hashmap.h>
+#include <gtest/gtest.h>
+#include "runner.h"
+
+using namespace ke;
+
+namespace {
+
+// Checks that every free is given the size that was allocated.
+class SizedPolicy : public SystemAllocatorPolicy
+{
+  public:
+    explicit SizedPolicy(std::map<void*, size_t>* live)
+     : live_(live)
+    {}
+
+    void* am_malloc(size_t bytes) {
+        void* ptr = SystemAllocatorPolicy::am_malloc(bytes);
+        (*live_)[ptr] = bytes;
+        return ptr;
+    }
+    void am_free(void* ptr, size_t bytes) {
+        auto iter = live_->find(ptr);
+        ASSERT_NE(iter, live_->end());
+        EXPECT_EQ(iter->second, bytes);
+        live_->erase(iter);
+        SystemAllocatorPolicy::am_free(ptr);
+    }
+    void* am_realloc(void* ptr, size_t oldBytes, size_t newBytes) {
+        auto iter = live_->find(ptr);
+        EXPECT_NE(iter, live_->end());
+        EXPECT_EQ(iter->second, oldBytes);
+        live_->erase(iter);
+        void* result = SystemAllocatorPolicy::am_realloc(ptr, oldBytes, newBytes);
+        (*live_)[result] = newBytes;
+        sReallocs++;
+        return result;
+    }
+
+    static size_t sReallocs;
+
+  private:
+    std::map<void*, size_t>* live_;
+};
+
+size_t SizedPolicy::sReallocs = 0;
+
+// Replaces am_malloc() without replacing the inherited am_realloc(), which
+// must then not be used.
+class CountingPolicy : public SystemAllocatorPolicy
+{
+  public:
+    void* am_malloc(size_t bytes) {
+        sMallocs++;
+        return SystemAllocatorPolicy::am_malloc(bytes);
+    }
+
+    static size_t sMallocs;
+};
+
+size_t CountingPolicy::sMallocs = 0;
+
+// Policies whose members cannot all be matched as plain member pointers.
+struct ConstPolicy
+{
+    void* am_malloc(size_t bytes) const noexcept {
+        return malloc(bytes);
+    }
+    void* am_realloc(void* ptr, size_t, size_t newBytes) const noexcept {
+        return realloc(ptr, newBytes);
+    }
+    void am_free(void* ptr) const {
+        free(ptr);
+    }
+    void reportOutOfMemory() const {}
+    void reportAllocationOverflow() const {}
+};
+
+struct StaticPolicy
+{
+    static void* am_malloc(size_t bytes) {
+        return malloc(bytes);
+    }
+    static void* am_realloc(void* ptr, size_t, size_t newBytes) {
+        return realloc(ptr, newBytes);
+    }
+    static void am_free(void* ptr) {
+        free(ptr);
+    }
+    void reportOutOfMemory() {}
+    void reportAllocationOverflow() {}
+};
+
+struct OverloadedPolicy : ConstPolicy
+{
+    void* am_malloc(size_t bytes) const {
+        return ConstPolicy::am_malloc(bytes);
+    }
+    void* am_malloc(size_t bytes, int) const {
+        return ConstPolicy::am_malloc(bytes);
+    }
+};
+
+struct alignas(64) Wide {
+    Wide() : value(0) {}
+    Wide(int value) : value(value) {}
+    int value;
+};
+
+bool
+IsAligned(const void* ptr, size_t alignment)
+{
+    return reinterpret_cast<uintptr_t>(ptr) % alignment == 0;
+}
+
+struct WidePolicy {
+    static inline uint32_t hash(int key) {
+        return HashInt32(key);
+    }
+    static inline bool matches(int find, int key) {
+        return find == key;
+    }
+};
+
+struct ControlWidePolicy : WidePolicy {
+    static const HashStorage kStorage = HashStorage::ControlBytes;
+};
+
+struct SplitWidePolicy : WidePolicy {
+    static const HashStorage kStorage = HashStorage::Split;
+};
+
+template <typename Policy>
+void
+TestWideHashMap(std::map<void*, size_t>* live)
+{
+    {
+        HashMap<int, Wide, Policy, SizedPolicy> map{SizedPolicy(live)};
+        ASSERT_TRUE(map.init());
+        for (int i = 0; i < 500; i++) {
+            auto p = map.findForAdd(i);
+            ASSERT_TRUE(map.add(p, i, Wide(i)));
+        }
+        for (int i = 0; i < 500; i++) {
+            auto r = map.find(i);
+            ASSERT_TRUE(r.found());
+            EXPECT_TRUE(IsAligned(&r->value, 64));
+            EXPECT_EQ(r->value.value, i);
+        }
+    }
+    EXPECT_TRUE(live->empty());
+}
+
+} // anonymous namespace
+
+TEST(AllocPolicy, Traits) {
+    static_assert(!AllocPolicyTraits<SystemAllocatorPolicy>::kHasAlignedMalloc, "");
+    static_assert(!AllocPolicyTraits<SystemAllocatorPolicy>::kHasSizedFree, "");
+    static_assert(AllocPolicyTraits<ArenaAllocatorPolicy>::kHasAlignedMalloc, "");
+    static_assert(!AllocPolicyTraits<ArenaAllocatorPolicy>::kHasSizedFree, "");
+    static_assert(!AllocPolicyTraits<SizedPolicy>::kHasAlignedMalloc, "");
+    static_assert(AllocPolicyTraits<SizedPolicy>::kHasSizedFree, "");
+
+    static_assert(AllocPolicyTraits<SystemAllocatorPolicy>::kHasRealloc, "");
+    static_assert(AllocPolicyTraits<ArenaAllocatorPolicy>::kHasRealloc, "");
+    static_assert(AllocPolicyTraits<SizedPolicy>::kHasRealloc, "");
+    static_assert(!AllocPolicyTraits<CountingPolicy>::kHasRealloc, "");
+
+    static_assert(IsTriviallyRelocatable<int>::value, "");
+    static_assert(IsTriviallyRelocatable<Wide>::value, "");
+    static_assert(!IsTriviallyRelocatable<std::string>::value, "");
+}
+
+TEST(AllocPolicy, Aligned) {
+    typedef AllocPolicyTraits<SystemAllocatorPolicy> Traits;
+
+    SystemAllocatorPolicy ap;
+    for (size_t alignment = 1; alignment <= 8192; alignment *= 2) {
+        void* ptr = Traits::allocate(&ap, 100, alignment);
+        ASSERT_NE(ptr, nullptr);
+        EXPECT_TRUE(IsAligned(ptr, alignment));
+        memset(ptr, 0xcc, 100);
+        Traits::release(&ap, ptr, 100, alignment);
+    }
+    Traits::release(&ap, nullptr, 0, 4096);
+
+    Arena<> arena;
+    ArenaAllocatorPolicy arenaPolicy(&arena);
+    void* ptr = AllocPolicyTraits<ArenaAllocatorPolicy>::allocate(&arenaPolicy, 10, 256);
+    EXPECT_TRUE(IsAligned(ptr, 256));
+}
+
+TEST(AllocPolicy, SizedFree) {
+    std::map<void*, size_t> live;
+    SizedPolicy ap(&live);
+
+    void* ptr = AllocPolicyTraits<SizedPolicy>::allocate(&ap, 100, 1024);
+    EXPECT_TRUE(IsAligned(ptr, 1024));
+    AllocPolicyTraits<SizedPolicy>::release(&ap, ptr, 100, 1024);
+    EXPECT_TRUE(live.empty());
+
+    {
+        FixedArray<Wide, SizedPolicy> array(10, ap);
+        ASSERT_TRUE(array.initialize());
+        for (size_t i = 0; i < array.size(); i++)
+            EXPECT_TRUE(IsAligned(&array[i], 64));
+        FixedArray<Wide, SizedPolicy> copy(array);
+        copy = FixedArray<Wide, SizedPolicy>(3, ap);
+    }
+    EXPECT_TRUE(live.empty());
+
+    {
+        BloomFilter<WidePolicy, SizedPolicy> filter(ap);
+        ASSERT_TRUE(filter.init(1000));
+        ASSERT_TRUE(filter.init(5000));
+        EXPECT_EQ(live.size(), (size_t)1);
+    }
+    EXPECT_TRUE(live.empty());
+}
+
+TEST(AllocPolicy, OverAlignedHashMap) {
+    std::map<void*, size_t> live;
+    TestWideHashMap<WidePolicy>(&live);
+    TestWideHashMap<ControlWidePolicy>(&live);
+    TestWideHashMap<SplitWidePolicy>(&live);
+}
+
+TEST(AllocPolicy, Realloc) {
+    typedef AllocPolicyTraits<CountingPolicy> Traits;
+
+    CountingPolicy ap;
+    CountingPolicy::sMallocs = 0;
+    char* ptr = (char*)Traits::reallocate(&ap, nullptr, 0, 10);
+    memcpy(ptr, "abcdefghij", 10);
+    ptr = (char*)Traits::reallocate(&ap, ptr, 10, 100000);
+    EXPECT_EQ(memcmp(ptr, "abcdefghij", 10), 0);
+    ptr = (char*)Traits::reallocate(&ap, ptr, 100000, 4);
+    EXPECT_EQ(memcmp(ptr, "abcd", 4), 0);
+    Traits::release(&ap, ptr, 4);
+    EXPECT_EQ(CountingPolicy::sMallocs, (size_t)3);
+
+    // The most recent arena allocation grows in place.
+    Arena<> arena;
+    ArenaAllocatorPolicy arenaPolicy(&arena);
+    void* first = arenaPolicy.am_malloc(16);
+    EXPECT_EQ(arenaPolicy.am_realloc(first, 16, 1000), first);
+    void* second = arenaPolicy.am_malloc(16);
+    void* moved = arenaPolicy.am_realloc(first, 1000, 2000);
+    EXPECT_NE(moved, first);
+    EXPECT_NE(moved, second);
+}
+
+TEST(AllocPolicy, ReallocDetection) {
+    static_assert(AllocPolicyTraits<SystemAllocatorPolicy>::kHasRealloc, "");
+    static_assert(AllocPolicyTraits<ConstPolicy>::kHasRealloc, "");
+    static_assert(!AllocPolicyTraits<CountingPolicy>::kHasRealloc, "");
+    // The declaring class cannot be told, so realloc is not trusted.
+    static_assert(!AllocPolicyTraits<StaticPolicy>::kHasRealloc, "");
+    static_assert(!AllocPolicyTraits<OverloadedPolicy>::kHasRealloc, "");
+
+    FixedArray<int, ConstPolicy> a(4);
+    ASSERT_TRUE(a.resize(1000));
+    FixedArray<int, StaticPolicy> b(4);
+    ASSERT_TRUE(b.resize(1000));
+    FixedArray<int, OverloadedPolicy> c(4);
+    ASSERT_TRUE(c.resize(1000));
+}
+
+TEST(AllocPolicy, FixedArrayResize) {
+    std::map<void*, size_t> live;
+    SizedPolicy ap(&live);
+    SizedPolicy::sReallocs = 0;
+
+    {
+        FixedArray<int, SizedPolicy> array(4, ap);
+        for (size_t i = 0; i < array.size(); i++)
+            array[i] = int(i);
+        ASSERT_TRUE(array.resize(100000));
+        EXPECT_EQ(array.size(), (size_t)100000);
+        for (size_t i = 0; i < 4; i++)
+            EXPECT_EQ(array[i], int(i));
+        EXPECT_EQ(array[99999], 0);
+        ASSERT_TRUE(array.resize(2));
+        EXPECT_EQ(array[1], 1);
+        EXPECT_EQ(SizedPolicy::sReallocs, (size_t)2);
+        ASSERT_TRUE(array.resize(0));
+        EXPECT_TRUE(array.empty());
+        EXPECT_TRUE(live.empty());
+        ASSERT_TRUE(array.resize(3));
+    }
+    EXPECT_TRUE(live.empty());
+
+    {
+        FixedArray<std::string, SizedPolicy> array(2, ap);
+        array[0] = "a string long enough not to be stored inline";
+        array[1] = "short";
+        ASSERT_TRUE(array.resize(50));
+        EXPECT_EQ(array[0], "a string long enough not to be stored inline");
+        EXPECT_EQ(array[1], "short");
+        EXPECT_TRUE(array[49].empty());
+        ASSERT_TRUE(array.resize(1));
+        EXPECT_EQ(array[0], "a string long enough not to be stored inline");
+        EXPECT_EQ(SizedPolicy::sReallocs, (size_t)2);
+    }
+    EXPECT_TRUE(live.empty());
+}
+
+TEST(AllocPolicy, OrderedHashMapRealloc) {
+    std::map<void*, size_t> live;
+    SizedPolicy::sReallocs = 0;
+    {
+        OrderedHashMap<int, int, WidePolicy, SizedPolicy> map{SizedPolicy(&live)};
+        ASSERT_TRUE(map.init());
+        for (int i = 0; i < 1000; i++) {
+            auto p = map.findForAdd(i);
+            ASSERT_TRUE(map.add(p, i, i * 3));
+        }
+        for (int i = 0; i < 1000; i++)
+            EXPECT_EQ(map.find(i)->value, i * 3);
+    }
+    EXPECT_GT(SizedPolicy::sReallocs, (size_t)0);
+    EXPECT_TRUE(live.empty());
+}
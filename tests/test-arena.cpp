@@ -0,0 +1,145 @@
+// vim: set sts=8 ts=2 sw=2 tw=99 et:
+//
+// Copyright (C) 2013, David Anderson and AlliedModders LLC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of AlliedModders LLC nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdint.h>
+
+#include <amtl/am-allocator-policies.h>
+#include <amtl/am-fixedarray.h>
+#include <amtl/am-hashmap.h>
+#include <amtl/am-hashset.h>
+#include <gtest/gtest.h>
+#include "runner.h"
+
+using namespace ke;
+
+namespace {
+
+struct IntPolicy {
+    static inline uint32_t hash(int key) {
+        return HashInt32(key);
+    }
+    static inline bool matches(int find, int key) {
+        return find == key;
+    }
+};
+
+bool
+IsAligned(void* ptr, size_t alignment)
+{
+    return reinterpret_cast<uintptr_t>(ptr) % alignment == 0;
+}
+
+} // anonymous namespace
+
+TEST(Arena, Allocate) {
+    Arena<> arena(4096);
+    EXPECT_EQ(arena.memoryUse(), (size_t)0);
+
+    char* a = (char*)arena.allocate(10);
+    char* b = (char*)arena.allocate(10);
+    ASSERT_NE(a, nullptr);
+    ASSERT_NE(b, nullptr);
+    EXPECT_TRUE(IsAligned(a, Arena<>::kDefaultAlignment));
+    EXPECT_TRUE(IsAligned(b, Arena<>::kDefaultAlignment));
+    EXPECT_GE(b - a, 10);
+    EXPECT_EQ(arena.memoryUse(), (size_t)4096);
+
+    void* c = arena.allocate(1, 256);
+    EXPECT_TRUE(IsAligned(c, 256));
+
+    // Filling the chunk moves on to another.
+    for (int i = 0; i < 100; i++)
+        arena.allocate(100);
+    EXPECT_GT(arena.memoryUse(), (size_t)4096);
+    size_t standard = arena.memoryUse();
+
+    // Large allocations get their own chunk, which reset() frees.
+    void* big = arena.allocate(100000);
+    ASSERT_NE(big, nullptr);
+    memset(big, 0xcc, 100000);
+    EXPECT_GT(arena.memoryUse(), standard + 100000);
+
+    arena.reset();
+    EXPECT_EQ(arena.memoryUse(), standard);
+
+    // Chunks are reused after a reset.
+    for (int i = 0; i < 100; i++)
+        arena.allocate(100);
+    EXPECT_EQ(arena.memoryUse(), standard);
+
+    arena.release();
+    EXPECT_EQ(arena.memoryUse(), (size_t)0);
+    EXPECT_NE(arena.allocate(8), nullptr);
+}
+
+TEST(Arena, Containers) {
+    Arena<> arena;
+    ArenaAllocatorPolicy ap(&arena);
+
+    for (int round = 0; round < 3; round++) {
+        {
+            HashMap<int, int, IntPolicy, ArenaAllocatorPolicy> map(ap);
+            ASSERT_TRUE(map.init());
+            for (int i = 0; i < 1000; i++) {
+                auto p = map.findForAdd(i);
+                ASSERT_TRUE(map.add(p, i, i * 2));
+            }
+            for (int i = 0; i < 1000; i++)
+                EXPECT_EQ(map.find(i)->value, i * 2);
+            map.removeIfExists(5);
+            EXPECT_FALSE(map.find(5).found());
+
+            HashSet<int, IntPolicy, ArenaAllocatorPolicy> set(ap);
+            ASSERT_TRUE(set.init());
+            for (int i = 0; i < 100; i++) {
+                auto p = set.findForAdd(i);
+                ASSERT_TRUE(set.add(p, i));
+            }
+            EXPECT_TRUE(set.has(50));
+
+            FixedArray<int, ArenaAllocatorPolicy> array(64, ap);
+            ASSERT_TRUE(array.initialize());
+            for (size_t i = 0; i < array.size(); i++)
+                array[i] = int(i);
+            FixedArray<int, ArenaAllocatorPolicy> copy(array);
+            EXPECT_TRUE(copy == array);
+            FixedArray<int, ArenaAllocatorPolicy> moved(std::move(copy));
+            EXPECT_EQ(moved[63], 63);
+        }
+
+        // Everything came from the arena, and the same chunks are reused
+        // every round.
+        EXPECT_GT(arena.memoryUse(), (size_t)0);
+        size_t used = arena.memoryUse();
+        arena.reset();
+        if (round > 0) {
+            EXPECT_LE(arena.memoryUse(), used);
+        }
+    }
+}
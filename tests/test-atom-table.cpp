@@ -0,0 +1,122 @@
+// vim: set sts=8 ts=2 sw=2 tw=99 et:
+//
+// Copyright (C) 2013, David Anderson and AlliedModders LLC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of AlliedModders LLC nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <amtl/am-atom-table.h>
+#include <amtl/am-hashmap.h>
+#include <gtest/gtest.h>
+#include "runner.h"
+
+using namespace ke;
+
+TEST(AtomTable, Basic) {
+    AtomTable<> atoms;
+    ASSERT_TRUE(atoms.init());
+
+    EXPECT_FALSE(atoms.find("cat"));
+
+    Atom cat = atoms.intern("cat");
+    ASSERT_TRUE(cat);
+    EXPECT_STREQ(cat.chars(), "cat");
+    EXPECT_EQ(cat.length(), (size_t)3);
+
+    EXPECT_EQ(atoms.intern(std::string("cat")), cat);
+    EXPECT_EQ(atoms.intern("catalog", 3), cat);
+    EXPECT_EQ(atoms.find("cat"), cat);
+    EXPECT_EQ(cat.hash(), atoms.intern("cat").hash());
+
+    Atom dog = atoms.intern("dog");
+    EXPECT_NE(cat, dog);
+    EXPECT_EQ(atoms.elements(), (size_t)2);
+    EXPECT_EQ(sizeof(Atom), sizeof(void*));
+
+    // Strings may contain null bytes, and may be empty.
+    Atom embedded = atoms.intern("a\0b", 3);
+    EXPECT_NE(embedded, atoms.intern("a"));
+    EXPECT_EQ(embedded.length(), (size_t)3);
+    EXPECT_EQ(atoms.intern("").length(), (size_t)0);
+
+    // Large strings get their own chunk, and stay intact.
+    std::string big(AtomTable<>::kChunkSize, 'x');
+    Atom bigAtom = atoms.intern(big);
+    EXPECT_EQ(std::string(bigAtom.chars(), bigAtom.length()), big);
+    EXPECT_EQ(atoms.intern("cat"), cat);
+}
+
+TEST(AtomTable, Stable) {
+    AtomTable<> atoms;
+    ASSERT_TRUE(atoms.init());
+
+    // Atoms and their characters must not move as the table grows.
+    std::vector<Atom> list;
+    std::vector<const char*> chars;
+    for (int i = 0; i < 20000; i++) {
+        list.push_back(atoms.intern("identifier_" + std::to_string(i)));
+        chars.push_back(list.back().chars());
+    }
+    for (int i = 0; i < 20000; i++) {
+        Atom atom = atoms.intern("identifier_" + std::to_string(i));
+        EXPECT_EQ(atom, list[i]);
+        EXPECT_EQ(atom.chars(), chars[i]);
+    }
+
+    HashMap<Atom, int, AtomPolicy> map;
+    ASSERT_TRUE(map.init());
+    for (int i = 0; i < 100; i++) {
+        auto p = map.findForAdd(list[i]);
+        ASSERT_TRUE(map.add(p, list[i], i));
+    }
+    EXPECT_EQ(map.find(atoms.intern("identifier_42"))->value, 42);
+}
+
+TEST(AtomTable, Threaded) {
+    static const int kThreads = 4;
+    static const int kNames = 1000;
+
+    AtomTable<> atoms;
+    ASSERT_TRUE(atoms.init());
+
+    std::vector<std::vector<Atom>> results(kThreads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([&atoms, &results, t]() -> void {
+            for (int i = 0; i < kNames; i++)
+                results[t].push_back(atoms.intern("name" + std::to_string(i)));
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    EXPECT_EQ(atoms.elements(), (size_t)kNames);
+    for (int t = 1; t < kThreads; t++)
+        EXPECT_EQ(results[t], results[0]);
+}
@@ -0,0 +1,146 @@
+// vim: set sts=8 ts=2 sw=2 tw=99 et:
+//
+// Copyright (C) 2013, David Anderson and AlliedModders LLC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of AlliedModders LLC nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <string>
+
+#include <amtl/am-bloom-filter.h>
+#include <amtl/am-hashmap.h>
+#include <amtl/am-string.h>
+#include <gtest/gtest.h>
+#include "runner.h"
+
+using namespace ke;
+
+namespace {
+
+struct IntPolicy {
+    static inline uint32_t hash(int key) {
+        return HashInt32(key);
+    }
+    static inline bool matches(int find, int key) {
+        return find == key;
+    }
+};
+
+double
+MeasureRate(double rate)
+{
+    static const int kKeys = 20000;
+    static const int kQueries = 200000;
+
+    BloomFilter<IntPolicy> filter;
+    EXPECT_TRUE(filter.init(kKeys, rate));
+    for (int i = 0; i < kKeys; i++)
+        filter.add(i * 2);
+    for (int i = 0; i < kKeys; i++)
+        EXPECT_TRUE(filter.mayContain(i * 2));
+
+    int positives = 0;
+    for (int i = 0; i < kQueries; i++) {
+        if (filter.mayContain(i * 2 + 1))
+            positives++;
+    }
+    return double(positives) / kQueries;
+}
+
+} // anonymous namespace
+
+TEST(BloomFilter, FalsePositiveRate) {
+    double rates[] = {0.1, 0.01, 0.001};
+    for (double rate : rates) {
+        double measured = MeasureRate(rate);
+        EXPECT_LT(measured, rate * 1.5);
+        EXPECT_GT(measured, rate / 4);
+    }
+}
+
+TEST(BloomFilter, Memory) {
+    BloomFilter<IntPolicy> loose;
+    BloomFilter<IntPolicy> tight;
+    EXPECT_EQ(loose.estimateMemoryUse(), (size_t)0);
+
+    ASSERT_TRUE(loose.init(10000, 0.05));
+    ASSERT_TRUE(tight.init(10000, 0.001));
+    EXPECT_LT(loose.estimateMemoryUse(), tight.estimateMemoryUse());
+
+    // About 10 bits per key at 1%, much less than a table of the keys.
+    BloomFilter<IntPolicy> filter;
+    ASSERT_TRUE(filter.init(10000, 0.01));
+    EXPECT_GT(filter.estimateMemoryUse(), (size_t)10000);
+    EXPECT_LT(filter.estimateMemoryUse(), (size_t)16000);
+
+    filter.add(5);
+    BloomFilter<IntPolicy> moved(std::move(filter));
+    EXPECT_TRUE(moved.mayContain(5));
+    EXPECT_EQ(filter.estimateMemoryUse(), (size_t)0);
+
+    moved.clear();
+    EXPECT_FALSE(moved.mayContain(5));
+}
+
+TEST(BloomFilter, FrontsHashMap) {
+    struct StringPolicy {
+        static inline uint32_t hash(const char* key) {
+            return FastHashCharSequence(key, strlen(key));
+        }
+        static inline uint32_t hash(const std::string& key) {
+            return FastHashCharSequence(key.c_str(), key.size());
+        }
+        static inline bool matches(const char* find, const std::string& key) {
+            return key.compare(find) == 0;
+        }
+        static inline bool matches(const std::string& find, const std::string& key) {
+            return key == find;
+        }
+    };
+
+    // The filter reuses the map's policy, for every lookup type.
+    HashMap<std::string, int, StringPolicy> map;
+    BloomFilter<StringPolicy> filter;
+    ASSERT_TRUE(map.init());
+    ASSERT_TRUE(filter.init(1000));
+    for (int i = 0; i < 1000; i++) {
+        std::string key = "key" + std::to_string(i);
+        auto p = map.findForAdd(key);
+        ASSERT_TRUE(map.add(p, key, i));
+        filter.add(key);
+    }
+
+    int rejected = 0;
+    for (int i = 0; i < 2000; i++) {
+        std::string key = "key" + std::to_string(i);
+        bool present = map.find(key).found();
+        EXPECT_EQ(present, i < 1000);
+        if (present)
+            EXPECT_TRUE(filter.mayContain(key.c_str()));
+        else if (!filter.mayContain(key.c_str()))
+            rejected++;
+    }
+    EXPECT_GT(rejected, 950);
+}
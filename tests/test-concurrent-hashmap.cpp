@@ -0,0 +1,202 @@
+// vim: set sts=8 ts=2 sw=2 tw=99 et:
+//
+// Copyright (C) 2013, David Anderson and AlliedModders LLC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of AlliedModders LLC nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <amtl/am-concurrent-hashmap.h>
+#include <amtl/am-string.h>
+#include <gtest/gtest.h>
+#include "runner.h"
+
+using namespace ke;
+
+namespace {
+
+struct IntPolicy {
+    static inline uint32_t hash(int key) {
+        return HashInt32(key);
+    }
+    static inline bool matches(int find, int key) {
+        return find == key;
+    }
+};
+
+struct StringPolicy {
+    static inline uint32_t hash(const char* key) {
+        return FastHashCharSequence(key, strlen(key));
+    }
+    static inline uint32_t hash(const std::string& key) {
+        return FastHashCharSequence(key.c_str(), key.size());
+    }
+    static inline bool matches(const char* find, const std::string& key) {
+        return key.compare(find) == 0;
+    }
+    static inline bool matches(const std::string& find, const std::string& key) {
+        return key == find;
+    }
+};
+
+} // anonymous namespace
+
+TEST(ConcurrentHashMap, Basic) {
+    ConcurrentHashMap<std::string, int, StringPolicy> map;
+    ASSERT_TRUE(map.init());
+    EXPECT_EQ(map.shards(), (size_t)16);
+
+    {
+        auto i = map.findForAdd("cat");
+        ASSERT_FALSE(i.found());
+        ASSERT_TRUE(map.add(i, "cat", 5));
+        EXPECT_EQ(i->value, 5);
+    }
+    {
+        auto r = map.find("cat");
+        ASSERT_TRUE(r.found());
+        static_assert(std::is_const<std::remove_reference<decltype(*r)>::type>::value,
+                      "find() results must be read-only");
+        EXPECT_EQ(r->key, "cat");
+        EXPECT_EQ(r->value, 5);
+    }
+
+    int value = 0;
+    EXPECT_TRUE(map.get("cat", &value));
+    EXPECT_EQ(value, 5);
+    EXPECT_FALSE(map.get("dog", &value));
+    EXPECT_FALSE(map.contains("dog"));
+
+    EXPECT_EQ(map.getOrInsert("dog", 7), 7);
+    EXPECT_EQ(map.getOrInsert("dog", 9), 7);
+    EXPECT_EQ(map.computeIfAbsent("cat", []() -> int { return 11; }), 5);
+    EXPECT_EQ(map.elements(), (size_t)2);
+
+    map.removeIfExists("cat");
+    EXPECT_FALSE(map.contains("cat"));
+    EXPECT_EQ(map.elements(), (size_t)1);
+
+    map.clear();
+    EXPECT_EQ(map.elements(), (size_t)0);
+}
+
+namespace {
+
+struct CountedCopies
+{
+    static int copies;
+
+    int n;
+
+    CountedCopies(int n)
+     : n(n)
+    {}
+    CountedCopies(const CountedCopies& other)
+     : n(other.n)
+    {
+        copies++;
+    }
+    CountedCopies(CountedCopies&& other)
+     : n(other.n)
+    {}
+    CountedCopies& operator =(const CountedCopies& other) = default;
+};
+
+int CountedCopies::copies = 0;
+
+} // anonymous namespace
+
+TEST(ConcurrentHashMap, GetOrInsertMoves) {
+    ConcurrentHashMap<std::string, CountedCopies, StringPolicy> map;
+    ASSERT_TRUE(map.init());
+
+    CountedCopies::copies = 0;
+    EXPECT_EQ(map.getOrInsert("cat", CountedCopies(3)).n, 3);
+    // One copy out of the map, none for the value going in.
+    EXPECT_EQ(CountedCopies::copies, 1);
+}
+
+TEST(ConcurrentHashMap, ShardSpread) {
+    ConcurrentHashMap<int, int, IntPolicy> map;
+    ASSERT_TRUE(map.init(4));
+    ASSERT_TRUE(map.reserve(1000));
+
+    for (int i = 0; i < 1000; i++)
+        EXPECT_EQ(map.getOrInsert(i, i * 2), i * 2);
+    EXPECT_EQ(map.elements(), (size_t)1000);
+
+    size_t sum = 0;
+    map.forEach([&sum](int key, int& value) -> void {
+        EXPECT_EQ(value, key * 2);
+        sum += key;
+    });
+    EXPECT_EQ(sum, (size_t)(999 * 1000 / 2));
+
+    // A single shard must behave like a plain HashMap.
+    ConcurrentHashMap<int, int, IntPolicy> single;
+    ASSERT_TRUE(single.init(1));
+    for (int i = 0; i < 100; i++)
+        single.getOrInsert(i, i);
+    EXPECT_EQ(single.elements(), (size_t)100);
+}
+
+TEST(ConcurrentHashMap, Threaded) {
+    static const int kThreads = 8;
+    static const int kKeys = 2000;
+
+    ConcurrentHashMap<int, int, IntPolicy> map;
+    ASSERT_TRUE(map.init());
+
+    std::atomic<int> computed(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([&map, &computed, t]() -> void {
+            for (int i = 0; i < kKeys; i++) {
+                int key = (i + t * 97) % kKeys;
+                int value = map.computeIfAbsent(key, [&computed, key]() -> int {
+                    computed++;
+                    return key + 1;
+                });
+                if (value != key + 1)
+                    computed += kKeys * kThreads;
+
+                int found = 0;
+                if (!map.get(key, &found) || found != key + 1)
+                    computed += kKeys * kThreads;
+            }
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    // Every key must have been computed exactly once.
+    EXPECT_EQ(computed.load(), kKeys);
+    EXPECT_EQ(map.elements(), (size_t)kKeys);
+}
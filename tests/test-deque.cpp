@@ -26,6 +26,7 @@
 // CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
+#include <amtl/am-allocator-policies.h>
 #include <amtl/am-deque.h>
 #include <assert.h>
 #include <gtest/gtest.h>
@@ -119,3 +120,18 @@ TEST(Deque, Move) {
     // Append so we can make sure that it's not holding a deleted pointer.
     dq1.push_back(11);
 }
+
+TEST(Deque, StdAllocator) {
+    Arena<> arena;
+    typedef StdAllocator<int, ArenaAllocatorPolicy> Alloc;
+    std::deque<int, Alloc> dq{Alloc(ArenaAllocatorPolicy(&arena))};
+
+    for (int i = 0; i < 1000; i++) {
+        dq.push_back(i);
+        dq.push_front(-i);
+    }
+    EXPECT_GT(arena.memoryUse(), (size_t)0);
+    EXPECT_EQ(PopFront(&dq), -999);
+    EXPECT_EQ(PopBack(&dq), 999);
+    EXPECT_EQ(dq.size(), (size_t)1998);
+}
@@ -0,0 +1,224 @@
+// vim: set sts=8 ts=2 sw=2 tw=99 et:
+//
+// Copyright (C) 2013, David Anderson and AlliedModders LLC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of AlliedModders LLC nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <utility>
+#include <vector>
+
+#include <amtl/am-frozen-hashmap.h>
+#include <gtest/gtest.h>
+#include "runner.h"
+
+using namespace ke;
+
+namespace {
+
+struct IntPolicy {
+    static inline uint32_t hash(int key) {
+        return HashInt32(key);
+    }
+    static inline bool matches(int find, int key) {
+        return find == key;
+    }
+};
+
+struct Point {
+    int32_t x;
+    int32_t y;
+};
+
+typedef HashMap<int, Point, IntPolicy> Map;
+typedef FrozenHashMap<int, Point, IntPolicy> Frozen;
+
+void
+BuildImage(int count, std::vector<uint8_t>* image)
+{
+    Map map;
+    ASSERT_TRUE(map.init());
+    for (int i = 0; i < count; i++) {
+        Map::Insert p = map.findForAdd(i * 3);
+        ASSERT_TRUE(map.add(p, i * 3, Point{i, -i}));
+    }
+    Frozen::Freeze(&map, image);
+}
+
+} // anonymous namespace
+
+TEST(FrozenHashMap, Basic) {
+    std::vector<uint8_t> image;
+    BuildImage(1000, &image);
+
+    // Lookups must not depend on where the image lives.
+    std::vector<uint8_t> copy(image);
+
+    Frozen frozen;
+    ASSERT_TRUE(frozen.init(copy.data(), copy.size()));
+    EXPECT_EQ(frozen.elements(), (size_t)1000);
+
+    for (int i = 0; i < 3000; i++) {
+        const Frozen::Entry* entry = frozen.find(i);
+        if (i % 3 != 0) {
+            EXPECT_EQ(entry, nullptr);
+            continue;
+        }
+        ASSERT_NE(entry, nullptr);
+        EXPECT_EQ(entry->key, i);
+        EXPECT_EQ(entry->value.x, i / 3);
+        EXPECT_EQ(entry->value.y, -(i / 3));
+    }
+
+    size_t count = 0;
+    int sum = 0;
+    frozen.forEach([&](const Frozen::Entry& entry) {
+        count++;
+        sum += entry.value.x;
+    });
+    EXPECT_EQ(count, (size_t)1000);
+    EXPECT_EQ(sum, 999 * 1000 / 2);
+}
+
+TEST(FrozenHashMap, Empty) {
+    std::vector<uint8_t> image;
+    BuildImage(0, &image);
+
+    Frozen frozen;
+    EXPECT_FALSE(frozen.contains(1));
+    ASSERT_TRUE(frozen.init(image.data(), image.size()));
+    EXPECT_EQ(frozen.elements(), (size_t)0);
+    EXPECT_FALSE(frozen.contains(0));
+}
+
+TEST(FrozenHashMap, Validation) {
+    std::vector<uint8_t> image;
+    BuildImage(100, &image);
+
+    Frozen frozen;
+    EXPECT_FALSE(frozen.init(image.data(), image.size() - 1));
+    EXPECT_FALSE(frozen.init(image.data(), 8));
+
+    // Wrong key or value types.
+    FrozenHashMap<int, int64_t, IntPolicy> wrongValue;
+    EXPECT_FALSE(wrongValue.init(image.data(), image.size()));
+
+    // Corrupt the magic, the byte order, and the version in turn.
+    size_t fields[] = {
+        0,
+        offsetof(detail::FrozenHashMapHeader, byteOrder),
+        offsetof(detail::FrozenHashMapHeader, version),
+    };
+    for (size_t offset : fields) {
+        std::vector<uint8_t> bad(image);
+        std::swap(bad[offset], bad[offset + 3]);
+        EXPECT_FALSE(frozen.init(bad.data(), bad.size()));
+    }
+
+    // An image whose sections do not add up.
+    std::vector<uint8_t> bad(image);
+    uint64_t capacity = 1 << 20;
+    memcpy(&bad[offsetof(detail::FrozenHashMapHeader, capacity)], &capacity, sizeof(capacity));
+    EXPECT_FALSE(frozen.init(bad.data(), bad.size()));
+
+    EXPECT_TRUE(frozen.init(image.data(), image.size()));
+    EXPECT_TRUE(frozen.contains(297));
+}
+
+TEST(FrozenHashMap, CorruptControlBytes) {
+    std::vector<uint8_t> image;
+    BuildImage(5, &image);
+
+    detail::FrozenHashMapHeader header;
+    memcpy(&header, image.data(), sizeof(header));
+    uint8_t* ctrl = &image[size_t(header.ctrlOffset)];
+    size_t capacity = size_t(header.capacity);
+
+    Frozen frozen;
+
+    // No empty slots left, which would make a missing key probe forever.
+    {
+        std::vector<uint8_t> bad(image);
+        uint8_t* badCtrl = &bad[size_t(header.ctrlOffset)];
+        for (size_t i = 0; i < capacity + detail::HashControlGroup::kWidth; i++) {
+            if (badCtrl[i] == detail::HashControlGroup::kEmpty)
+                badCtrl[i] = 0x01;
+        }
+        EXPECT_FALSE(frozen.init(bad.data(), bad.size()));
+    }
+
+    // An invalid control byte.
+    {
+        std::vector<uint8_t> bad(image);
+        for (size_t i = 0; i < capacity; i++) {
+            if (ctrl[i] == detail::HashControlGroup::kEmpty) {
+                bad[size_t(header.ctrlOffset) + i] = 0xfe;
+                break;
+            }
+        }
+        EXPECT_FALSE(frozen.init(bad.data(), bad.size()));
+    }
+
+    // A mirror byte that does not match the start of the table.
+    {
+        std::vector<uint8_t> bad(image);
+        bad[size_t(header.ctrlOffset) + capacity] ^= 0x01;
+        EXPECT_FALSE(frozen.init(bad.data(), bad.size()));
+    }
+
+    ASSERT_TRUE(frozen.init(image.data(), image.size()));
+    EXPECT_FALSE(frozen.contains(12345));
+}
+
+TEST(FrozenHashMap, Padding) {
+    typedef FrozenHashMap<int32_t, int64_t, IntPolicy> Padded;
+    static_assert(offsetof(Padded::Entry, value) > sizeof(int32_t), "entry must have padding");
+
+    HashMap<int32_t, int64_t, IntPolicy> map;
+    ASSERT_TRUE(map.init());
+    for (int i = 0; i < 50; i++) {
+        auto p = map.findForAdd(i);
+        ASSERT_TRUE(map.add(p, i, -1));
+    }
+    std::vector<uint8_t> image;
+    Padded::Freeze(&map, &image);
+
+    // Padding between the key and value is left zeroed.
+    detail::FrozenHashMapHeader header;
+    memcpy(&header, image.data(), sizeof(header));
+    for (uint64_t i = 0; i < header.capacity; i++) {
+        const uint8_t* entry = &image[size_t(header.entriesOffset + i * sizeof(Padded::Entry))];
+        for (size_t j = sizeof(int32_t); j < offsetof(Padded::Entry, value); j++)
+            EXPECT_EQ(entry[j], 0);
+    }
+
+    Padded frozen;
+    ASSERT_TRUE(frozen.init(image.data(), image.size()));
+    EXPECT_EQ(frozen.find(49)->value, -1);
+}
@@ -27,7 +27,12 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+#include <algorithm>
+#include <vector>
+
+#include <amtl/am-hashed-string.h>
 #include <amtl/am-hashmap.h>
+#include <amtl/am-rehash-threads.h>
 #include <amtl/am-string.h>
 #include <amtl/am-utility.h>
 #include <gtest/gtest.h>
@@ -39,9 +44,15 @@ struct StringPolicy {
     static inline uint32_t hash(const char* key) {
         return FastHashCharSequence(key, strlen(key));
     }
+    static inline uint32_t hash(const std::string& key) {
+        return FastHashCharSequence(key.c_str(), key.size());
+    }
     static inline bool matches(const char* find, const std::string& key) {
         return key.compare(find) == 0;
     }
+    static inline bool matches(const std::string& find, const std::string& key) {
+        return key == find;
+    }
 };
 
 TEST(HashMap, Basic) {
@@ -123,3 +134,894 @@ TEST(HashMap, Bug6527) {
         }
     }
 }
+
+struct ControlStringPolicy : public StringPolicy {
+    static const HashStorage kStorage = HashStorage::ControlBytes;
+};
+
+TEST(HashMap, ControlBytes) {
+    typedef HashMap<std::string, int, ControlStringPolicy> Map;
+    Map map;
+
+    ASSERT_TRUE(map.init());
+
+    Map::Result r = map.find("cat");
+    ASSERT_FALSE(r.found());
+
+    Map::Insert i = map.findForAdd("cat");
+    ASSERT_FALSE(i.found());
+    ASSERT_TRUE(map.add(i, std::string("cat"), 5));
+    EXPECT_EQ(r->value, 5);
+
+    r = map.find("cat");
+    ASSERT_TRUE(r.found());
+    EXPECT_EQ(r->value, 5);
+    map.remove(r);
+
+    r = map.find("cat");
+    EXPECT_FALSE(r.found());
+}
+
+// Only a few distinct hashes, so that probes must walk long collision chains.
+struct CollidingIntPolicy {
+    static const HashStorage kStorage = HashStorage::ControlBytes;
+
+    static inline uint32_t hash(int key) {
+        return key % 7;
+    }
+    static inline bool matches(int find, int key) {
+        return find == key;
+    }
+};
+
+TEST(HashMap, ControlBytesCollisions) {
+    typedef HashMap<int, int, CollidingIntPolicy> Map;
+    Map map;
+
+    ASSERT_TRUE(map.init());
+
+    for (int i = 0; i < 500; i++) {
+        Map::Insert p = map.findForAdd(i);
+        ASSERT_FALSE(p.found());
+        ASSERT_TRUE(map.add(p, i, i * 10));
+    }
+    EXPECT_EQ(map.elements(), (size_t)500);
+
+    for (int i = 0; i < 500; i += 2)
+        map.removeIfExists(i);
+    EXPECT_EQ(map.elements(), (size_t)250);
+
+    for (int i = 0; i < 500; i++) {
+        Map::Result r = map.find(i);
+        if (i % 2 == 0) {
+            EXPECT_FALSE(r.found());
+        } else {
+            ASSERT_TRUE(r.found());
+            EXPECT_EQ(r->value, i * 10);
+        }
+    }
+
+    // Re-adding should reuse removed slots without duplicating live keys.
+    for (int i = 0; i < 500; i++) {
+        Map::Insert p = map.findForAdd(i);
+        if (!p.found()) {
+            ASSERT_TRUE(map.add(p, i, i * 10));
+        }
+    }
+    EXPECT_EQ(map.elements(), (size_t)500);
+
+    size_t count = 0;
+    for (Map::iterator iter = map.iter(); !iter.empty(); iter.next()) {
+        EXPECT_EQ(iter->value, iter->key * 10);
+        count++;
+    }
+    EXPECT_EQ(count, (size_t)500);
+}
+
+struct IntPolicy {
+    static inline uint32_t hash(int key) {
+        return HashInt32(key);
+    }
+    static inline bool matches(int find, int key) {
+        return find == key;
+    }
+};
+
+struct BackwardShiftIntPolicy : public IntPolicy {
+    static const HashDeletion kDeletion = HashDeletion::BackwardShift;
+};
+
+struct BackwardShiftCollidingPolicy : public CollidingIntPolicy {
+    static const HashStorage kStorage = HashStorage::Inline;
+    static const HashDeletion kDeletion = HashDeletion::BackwardShift;
+};
+
+// Keep a fixed number of keys live while constantly replacing them, and
+// return whether the table ever had to be resized.
+template <typename Map>
+static bool
+ChurnResizes(Map& map)
+{
+    const int kLive = 10;
+
+    for (int i = 0; i < kLive; i++) {
+        typename Map::Insert p = map.findForAdd(i);
+        map.add(p, i, i);
+    }
+
+    size_t memory = map.estimateMemoryUse();
+    bool resized = false;
+    for (int i = kLive; i < 10000; i++) {
+        map.removeIfExists(i - kLive);
+        typename Map::Insert p = map.findForAdd(i);
+        map.add(p, i, i);
+        if (map.estimateMemoryUse() != memory)
+            resized = true;
+    }
+    return resized;
+}
+
+TEST(HashMap, BackwardShiftChurn) {
+    HashMap<int, int, IntPolicy> tombstones;
+    ASSERT_TRUE(tombstones.init());
+    EXPECT_TRUE(ChurnResizes(tombstones));
+
+    HashMap<int, int, BackwardShiftIntPolicy> shifted;
+    ASSERT_TRUE(shifted.init());
+    EXPECT_FALSE(ChurnResizes(shifted));
+    EXPECT_EQ(shifted.elements(), (size_t)10);
+    for (int i = 0; i < 10000; i++)
+        EXPECT_EQ(shifted.find(i).found(), i >= 10000 - 10);
+}
+
+TEST(HashMap, BackwardShiftCollisions) {
+    typedef HashMap<int, int, BackwardShiftCollidingPolicy> Map;
+    Map map;
+
+    ASSERT_TRUE(map.init());
+
+    for (int i = 0; i < 300; i++) {
+        Map::Insert p = map.findForAdd(i);
+        ASSERT_FALSE(p.found());
+        ASSERT_TRUE(map.add(p, i, i * 10));
+    }
+
+    // Remove from the middle of the collision chains.
+    for (int i = 0; i < 300; i += 3)
+        map.removeIfExists(i);
+    EXPECT_EQ(map.elements(), (size_t)200);
+
+    for (int i = 0; i < 300; i++) {
+        Map::Result r = map.find(i);
+        if (i % 3 == 0) {
+            EXPECT_FALSE(r.found());
+        } else {
+            ASSERT_TRUE(r.found());
+            EXPECT_EQ(r->value, i * 10);
+        }
+    }
+}
+
+TEST(HashMap, BackwardShiftEraseDuringIteration) {
+    typedef HashMap<int, int, BackwardShiftCollidingPolicy> Map;
+    Map map;
+
+    ASSERT_TRUE(map.init());
+
+    for (int i = 0; i < 100; i++) {
+        Map::Insert p = map.findForAdd(i);
+        ASSERT_TRUE(map.add(p, i, i));
+    }
+
+    // Every entry must be visited exactly once, even though erasing shifts
+    // later entries back into already-visited slots.
+    size_t visited = 0;
+    for (Map::iterator iter = map.iter(); !iter.empty(); iter.next()) {
+        visited++;
+        if (iter->key % 2 == 0)
+            iter.erase();
+    }
+    EXPECT_EQ(visited, (size_t)100);
+    EXPECT_EQ(map.elements(), (size_t)50);
+
+    visited = 0;
+    for (Map::iterator iter = map.iter(); !iter.empty(); iter.next()) {
+        EXPECT_EQ(iter->key % 2, 1);
+        visited++;
+    }
+    EXPECT_EQ(visited, (size_t)50);
+}
+
+struct RobinHoodIntPolicy : public IntPolicy {
+    static const HashProbing kProbing = HashProbing::RobinHood;
+};
+
+struct RobinHoodCollidingPolicy : public CollidingIntPolicy {
+    static const HashStorage kStorage = HashStorage::Inline;
+    static const HashProbing kProbing = HashProbing::RobinHood;
+};
+
+TEST(HashMap, RobinHood) {
+    typedef HashMap<int, int, RobinHoodCollidingPolicy> Map;
+    Map map;
+
+    ASSERT_TRUE(map.init());
+
+    for (int i = 0; i < 300; i++) {
+        Map::Insert p = map.findForAdd(i);
+        ASSERT_FALSE(p.found());
+        ASSERT_TRUE(map.add(p, i, i * 10));
+
+        // The Insert must still refer to the new entry, even if adding it
+        // displaced others.
+        ASSERT_TRUE(p.found());
+        EXPECT_EQ(p->key, i);
+    }
+
+    for (int i = 0; i < 300; i += 3)
+        map.removeIfExists(i);
+    EXPECT_EQ(map.elements(), (size_t)200);
+
+    for (int i = 0; i < 400; i++) {
+        Map::Result r = map.find(i);
+        if (i >= 300 || i % 3 == 0) {
+            EXPECT_FALSE(r.found());
+        } else {
+            ASSERT_TRUE(r.found());
+            EXPECT_EQ(r->value, i * 10);
+        }
+    }
+
+    size_t visited = 0;
+    for (Map::iterator iter = map.iter(); !iter.empty(); iter.next()) {
+        visited++;
+        if (iter->key % 2 == 0)
+            iter.erase();
+    }
+    EXPECT_EQ(visited, (size_t)200);
+    EXPECT_EQ(map.elements(), (size_t)100);
+    for (int i = 0; i < 300; i++)
+        EXPECT_EQ(map.find(i).found(), i % 3 != 0 && i % 2 != 0);
+}
+
+TEST(HashMap, RobinHoodLoadFactor) {
+    HashMap<int, int, IntPolicy> linear;
+    HashMap<int, int, RobinHoodIntPolicy> robinHood;
+    ASSERT_TRUE(linear.init(64));
+    ASSERT_TRUE(robinHood.init(64));
+
+    size_t linearMemory = linear.estimateMemoryUse();
+    size_t robinHoodMemory = robinHood.estimateMemoryUse();
+
+    // 57 entries is 89% of 64 slots.
+    for (int i = 0; i < 57; i++) {
+        HashMap<int, int, IntPolicy>::Insert p = linear.findForAdd(i);
+        ASSERT_TRUE(linear.add(p, i, i));
+        HashMap<int, int, RobinHoodIntPolicy>::Insert q = robinHood.findForAdd(i);
+        ASSERT_TRUE(robinHood.add(q, i, i));
+    }
+
+    EXPECT_GT(linear.estimateMemoryUse(), linearMemory);
+    EXPECT_EQ(robinHood.estimateMemoryUse(), robinHoodMemory);
+    for (int i = 0; i < 57; i++)
+        EXPECT_TRUE(robinHood.find(i).found());
+}
+
+struct IncrementalIntPolicy : public IntPolicy {
+    static const HashResize kResize = HashResize::Incremental;
+};
+
+template <typename Map>
+static void
+TestIncrementalResize()
+{
+    Map map;
+    ASSERT_TRUE(map.init());
+
+    // Fill until the table starts growing. While both tables are alive, the
+    // memory estimate covers both of them.
+    size_t initialMemory = map.estimateMemoryUse();
+    int n = 0;
+    while (map.estimateMemoryUse() < initialMemory * 3) {
+        typename Map::Insert p = map.findForAdd(n);
+        ASSERT_FALSE(p.found());
+        ASSERT_TRUE(map.add(p, n, n));
+        n++;
+    }
+
+    // Mix lookups, removals and additions while the migration is running.
+    for (int i = 0; i < n; i++)
+        EXPECT_TRUE(map.find(i).found());
+    map.removeIfExists(0);
+    EXPECT_FALSE(map.find(0).found());
+    {
+        typename Map::Insert p = map.findForAdd(1);
+        ASSERT_TRUE(p.found());
+        p->value = 100;
+    }
+
+    for (int i = n; i < n + 1000; i++) {
+        typename Map::Insert p = map.findForAdd(i);
+        ASSERT_FALSE(p.found());
+        ASSERT_TRUE(map.add(p, i, i));
+    }
+    for (int i = n; i < n + 500; i++)
+        map.removeIfExists(i);
+
+    EXPECT_EQ(map.elements(), size_t(n - 1 + 500));
+    EXPECT_EQ(map.find(1)->value, 100);
+    for (int i = 1; i < n + 1000; i++)
+        EXPECT_EQ(map.find(i).found(), i < n || i >= n + 500);
+
+    size_t count = 0;
+    for (typename Map::iterator iter = map.iter(); !iter.empty(); iter.next())
+        count++;
+    EXPECT_EQ(count, map.elements());
+}
+
+TEST(HashMap, IncrementalResize) {
+    TestIncrementalResize<HashMap<int, int, IncrementalIntPolicy>>();
+}
+
+struct IncrementalControlPolicy : public IncrementalIntPolicy {
+    static const HashStorage kStorage = HashStorage::ControlBytes;
+};
+
+struct IncrementalRobinHoodPolicy : public IncrementalIntPolicy {
+    static const HashProbing kProbing = HashProbing::RobinHood;
+};
+
+TEST(HashMap, IncrementalResizeStorages) {
+    TestIncrementalResize<HashMap<int, int, IncrementalControlPolicy>>();
+    TestIncrementalResize<HashMap<int, int, IncrementalRobinHoodPolicy>>();
+}
+
+TEST(HashMap, Reserve) {
+    typedef HashMap<int, int, IntPolicy> Map;
+    Map map;
+
+    // reserve() initializes the map, and does not need a power of two.
+    ASSERT_TRUE(map.reserve(1000));
+    size_t memory = map.estimateMemoryUse();
+
+    for (int i = 0; i < 1000; i++) {
+        Map::Insert p = map.findForAdd(i);
+        ASSERT_TRUE(map.add(p, i, i));
+    }
+    EXPECT_EQ(map.estimateMemoryUse(), memory);
+
+    // Reserving less than the current size is a no-op.
+    ASSERT_TRUE(map.reserve(10));
+    EXPECT_EQ(map.estimateMemoryUse(), memory);
+
+    ASSERT_TRUE(map.reserve(5000));
+    EXPECT_GT(map.estimateMemoryUse(), memory);
+    for (int i = 0; i < 1000; i++)
+        EXPECT_TRUE(map.find(i).found());
+}
+
+TEST(HashMap, AddAll) {
+    typedef HashMap<std::string, int, StringPolicy> Map;
+    Map map;
+    ASSERT_TRUE(map.init());
+
+    Map::Insert p = map.findForAdd("dog");
+    ASSERT_TRUE(map.add(p, std::string("dog"), 1));
+
+    std::vector<std::pair<std::string, int>> items;
+    for (int i = 0; i < 100; i++)
+        items.emplace_back("key" + std::to_string(i), i);
+    items.emplace_back("dog", 2);
+    items.emplace_back("key5", 500);
+
+    ASSERT_TRUE(map.addAll(items));
+    EXPECT_EQ(map.elements(), (size_t)101);
+
+    // Keys already present keep their first value.
+    EXPECT_EQ(map.find("dog")->value, 1);
+    EXPECT_EQ(map.find("key5")->value, 5);
+    for (int i = 0; i < 100; i++)
+        EXPECT_EQ(map.find(("key" + std::to_string(i)).c_str())->value, i);
+}
+
+namespace {
+
+// Yields pairs by value, as generators and transforming iterators do.
+class PairGenerator
+{
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef std::pair<std::string, int> value_type;
+    typedef ptrdiff_t difference_type;
+    typedef const value_type* pointer;
+    typedef value_type reference;
+
+    explicit PairGenerator(int i)
+     : i_(i)
+    {}
+
+    value_type operator *() const {
+        return value_type("generated key " + std::to_string(i_), i_);
+    }
+    PairGenerator& operator ++() {
+        i_++;
+        return *this;
+    }
+    bool operator ==(const PairGenerator& other) const {
+        return i_ == other.i_;
+    }
+    bool operator !=(const PairGenerator& other) const {
+        return i_ != other.i_;
+    }
+
+  private:
+    int i_;
+};
+
+} // anonymous namespace
+
+TEST(HashMap, AddAllGenerated) {
+    typedef HashMap<std::string, int, StringPolicy> Map;
+    Map map;
+    ASSERT_TRUE(map.init());
+
+    ASSERT_TRUE(map.addAll(PairGenerator(0), PairGenerator(100)));
+    ASSERT_TRUE(map.addAll(PairGenerator(50), PairGenerator(150)));
+    EXPECT_EQ(map.elements(), (size_t)150);
+    for (int i = 0; i < 150; i++)
+        EXPECT_EQ(map.find(("generated key " + std::to_string(i)).c_str())->value, i);
+}
+
+TEST(HashMap, AddValueFromSameMap) {
+    // Copying an existing value under a new key must work across the add
+    // that grows the table.
+    HashMap<int, std::string, IntPolicy> map;
+    ASSERT_TRUE(map.init(16));
+
+    auto first = map.findForAdd(0);
+    ASSERT_TRUE(map.add(first, 0, std::string("a value too long to fit in SSO storage")));
+    for (int i = 1; i < 200; i++) {
+        auto r = map.find(i - 1);
+        auto p = map.findForAdd(i);
+        ASSERT_TRUE(map.add(p, i, r->value));
+    }
+    for (int i = 0; i < 200; i++)
+        EXPECT_EQ(map.find(i)->value, "a value too long to fit in SSO storage");
+
+    std::string value("emplaced");
+    auto p = map.findForAdd(200);
+    ASSERT_TRUE(map.emplace(p, 200, std::move(value)));
+    EXPECT_EQ(p->value, "emplaced");
+}
+
+TEST(HashMap, FindMany) {
+    typedef HashMap<int, int, IntPolicy> Map;
+    Map map;
+    ASSERT_TRUE(map.init());
+
+    for (int i = 0; i < 1000; i += 2) {
+        Map::Insert p = map.findForAdd(i);
+        ASSERT_TRUE(map.add(p, i, i * 3));
+    }
+
+    std::vector<int> keys;
+    for (int i = 0; i < 100; i++)
+        keys.push_back((i * 37) % 1000);
+
+    std::vector<Map::Result> results;
+    map.findMany(keys, std::back_inserter(results));
+    ASSERT_EQ(results.size(), keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        ASSERT_EQ(results[i].found(), keys[i] % 2 == 0);
+        if (results[i].found()) {
+            EXPECT_EQ(results[i]->value, keys[i] * 3);
+        }
+    }
+}
+
+TEST(HashMap, HashCharSequence64) {
+    // Published wyhash test vectors.
+    EXPECT_EQ(HashCharSequence64("", 0, 0), 0x93228a4de0eec5a2ull);
+    EXPECT_EQ(HashCharSequence64("a", 1, 1), 0xc5bac3db178713c4ull);
+    EXPECT_EQ(HashCharSequence64("abc", 3, 2), 0xa97f2f7b1d9b3314ull);
+    EXPECT_EQ(HashCharSequence64("message digest", 14, 3), 0x786d1f1df3801df4ull);
+
+    const char* digits =
+        "12345678901234567890123456789012345678901234567890123456789012345678901234567890";
+    EXPECT_EQ(HashCharSequence64(digits, strlen(digits), 6), 0x6cc5eab49a92d617ull);
+
+    // Streaming must agree with the one-shot hash for every length, however
+    // the input is split.
+    char text[200];
+    for (size_t i = 0; i < sizeof(text); i++)
+        text[i] = char('a' + (i * 7) % 26);
+
+    for (size_t length = 0; length <= sizeof(text); length++) {
+        uint64_t expected = HashCharSequence64(text, length, 42);
+        for (size_t step = 1; step <= 67; step += 11) {
+            WordStreamHasher hasher(42);
+            for (size_t pos = 0; pos < length; pos += step)
+                hasher.add(text + pos, std::min(step, length - pos));
+            ASSERT_EQ(hasher.result(), expected) << length << " " << step;
+        }
+
+        WordStreamHasher bytes(42);
+        for (size_t pos = 0; pos < length; pos++)
+            bytes.add(text[pos]);
+        ASSERT_EQ(bytes.result(), expected) << length;
+    }
+}
+
+TEST(HashMap, HashCharSequence64Collisions) {
+    // Keys that differ in a single position should never share a truncated
+    // 32-bit hash in a set this small.
+    std::vector<uint32_t> hashes;
+    char key[64];
+    memset(key, 'x', sizeof(key));
+    for (size_t pos = 0; pos < sizeof(key); pos++) {
+        for (int c = 0; c < 256; c++) {
+            if (c == 'x')
+                continue;
+            key[pos] = char(c);
+            hashes.push_back(uint32_t(HashCharSequence64(key, sizeof(key))));
+        }
+        key[pos] = 'x';
+    }
+
+    std::sort(hashes.begin(), hashes.end());
+    EXPECT_EQ(std::adjacent_find(hashes.begin(), hashes.end()), hashes.end());
+}
+
+struct Wide64StringPolicy {
+    static const HashWidth kWidth = HashWidth::Bits64;
+
+    static inline uint64_t hash(const char* key) {
+        return HashCharSequence64(key, strlen(key));
+    }
+    static inline uint64_t hash(const std::string& key) {
+        return HashCharSequence64(key.c_str(), key.size());
+    }
+    static inline bool matches(const char* find, const std::string& key) {
+        return key.compare(find) == 0;
+    }
+    static inline bool matches(const std::string& find, const std::string& key) {
+        return key == find;
+    }
+};
+
+struct Wide64ControlStringPolicy : public Wide64StringPolicy {
+    static const HashStorage kStorage = HashStorage::ControlBytes;
+};
+
+struct Wide64RobinHoodStringPolicy : public Wide64StringPolicy {
+    static const HashProbing kProbing = HashProbing::RobinHood;
+};
+
+struct Wide64IncrementalPolicy : public IncrementalIntPolicy {
+    static const HashWidth kWidth = HashWidth::Bits64;
+};
+
+template <typename Map>
+static void
+TestWideHashes()
+{
+    Map map;
+    ASSERT_TRUE(map.init());
+
+    for (int i = 0; i < 5000; i++) {
+        std::string key = "key" + std::to_string(i);
+        typename Map::Insert p = map.findForAdd(key);
+        ASSERT_FALSE(p.found());
+        ASSERT_TRUE(map.add(p, key, i));
+    }
+    for (int i = 0; i < 5000; i += 2)
+        map.removeIfExists("key" + std::to_string(i));
+
+    EXPECT_EQ(map.elements(), (size_t)2500);
+    for (int i = 0; i < 5000; i++) {
+        typename Map::Result r = map.find("key" + std::to_string(i));
+        ASSERT_EQ(r.found(), i % 2 == 1);
+        if (r.found()) {
+            EXPECT_EQ(r->value, i);
+        }
+    }
+}
+
+TEST(HashMap, Wide64) {
+    TestWideHashes<HashMap<std::string, int, Wide64StringPolicy>>();
+    TestWideHashes<HashMap<std::string, int, Wide64ControlStringPolicy>>();
+    TestWideHashes<HashMap<std::string, int, Wide64RobinHoodStringPolicy>>();
+    TestIncrementalResize<HashMap<int, int, Wide64IncrementalPolicy>>();
+}
+
+struct SplitCollidingPolicy : public CollidingIntPolicy {
+    static const HashStorage kStorage = HashStorage::Split;
+};
+
+struct SplitBackwardShiftPolicy : public SplitCollidingPolicy {
+    static const HashDeletion kDeletion = HashDeletion::BackwardShift;
+};
+
+template <typename Map>
+static void
+TestSplitStorage()
+{
+    Map map;
+    ASSERT_TRUE(map.init());
+
+    for (int i = 0; i < 300; i++) {
+        typename Map::Insert p = map.findForAdd(i);
+        ASSERT_FALSE(p.found());
+        ASSERT_TRUE(map.add(p, i, i * 10));
+    }
+    for (int i = 0; i < 300; i += 3)
+        map.removeIfExists(i);
+    EXPECT_EQ(map.elements(), (size_t)200);
+
+    for (int i = 0; i < 300; i++) {
+        typename Map::Result r = map.find(i);
+        ASSERT_EQ(r.found(), i % 3 != 0);
+        if (r.found()) {
+            EXPECT_EQ(r->value, i * 10);
+        }
+    }
+
+    size_t count = 0;
+    for (typename Map::iterator iter = map.iter(); !iter.empty(); iter.next()) {
+        if (iter->key % 2 == 0)
+            iter.erase();
+        else
+            count++;
+    }
+    EXPECT_EQ(count, map.elements());
+    for (int i = 0; i < 300; i++)
+        EXPECT_EQ(map.find(i).found(), i % 3 != 0 && i % 2 != 0);
+}
+
+struct SplitPointerPolicy : public PointerPolicy<void> {
+    static const HashStorage kStorage = HashStorage::Split;
+};
+
+TEST(HashMap, SplitStorage) {
+    TestSplitStorage<HashMap<int, int, SplitCollidingPolicy>>();
+    TestSplitStorage<HashMap<int, int, SplitBackwardShiftPolicy>>();
+
+    // Pointer-sized payloads no longer pay for padding after the hash.
+    HashMap<void*, void*, PointerPolicy<void>> inlined;
+    HashMap<void*, void*, SplitPointerPolicy> split;
+    ASSERT_TRUE(inlined.init(1024));
+    ASSERT_TRUE(split.init(1024));
+    EXPECT_LT(split.estimateMemoryUse(), inlined.estimateMemoryUse());
+}
+
+struct CountingStringPolicy : public StringHashPolicy {
+    static size_t sHashes;
+
+    template <typename Lookup>
+    static uint64_t hash(const Lookup& key) {
+        sHashes++;
+        return StringHashPolicy::hash(key);
+    }
+};
+size_t CountingStringPolicy::sHashes = 0;
+
+TEST(HashMap, PrecomputedHash) {
+    typedef HashMap<std::string, int, CountingStringPolicy> Map;
+    Map map;
+    ASSERT_TRUE(map.init());
+
+    uint64_t hash = StringHashPolicy::hash("cat");
+    CountingStringPolicy::sHashes = 0;
+    {
+        Map::Insert p = map.findForAdd(hash, "cat");
+        ASSERT_FALSE(p.found());
+        ASSERT_TRUE(map.add(p, "cat", 3));
+    }
+    for (int i = 0; i < 10; i++) {
+        Map::Result r = map.find(hash, "cat");
+        ASSERT_TRUE(r.found());
+        EXPECT_EQ(r->value, 3);
+    }
+    EXPECT_EQ(CountingStringPolicy::sHashes, (size_t)0);
+
+    // Precomputed and ordinary lookups agree.
+    EXPECT_TRUE(map.find("cat").found());
+    EXPECT_FALSE(map.find(StringHashPolicy::hash("dog"), "dog").found());
+}
+
+TEST(HashMap, HashedString) {
+    typedef HashMap<std::string, int, StringHashPolicy> Map;
+    Map map;
+    ASSERT_TRUE(map.init());
+
+    for (int i = 0; i < 100; i++) {
+        std::string key = "name" + std::to_string(i);
+        HashedString hashed(key);
+        Map::Insert p = map.findForAdd(hashed);
+        ASSERT_FALSE(p.found());
+        ASSERT_TRUE(map.add(p, key, i));
+    }
+
+    std::string name = "name42";
+    HashedString hashed(name);
+    EXPECT_EQ(hashed.hash(), HashCharSequence64(name.c_str(), name.size()));
+    EXPECT_EQ(map.find(hashed)->value, 42);
+    EXPECT_EQ(map.find("name42")->value, 42);
+    EXPECT_EQ(map.find(name)->value, 42);
+    EXPECT_FALSE(map.find(HashedString("name100")).found());
+
+    // A HashedString need not be null-terminated.
+    EXPECT_EQ(map.find(HashedString("name7xyz", 5))->value, 7);
+}
+
+struct StatsIntPolicy : public IntPolicy {
+    static const HashStats kStats = HashStats::Enabled;
+};
+
+template <typename Map>
+static size_t
+SumProbes(const Map& map)
+{
+    HashTableStats stats = map.stats();
+    size_t total = 0;
+    for (size_t i = 0; i < HashTableStats::kProbeBuckets; i++)
+        total += stats.probes[i];
+    return total;
+}
+
+TEST(HashMap, Stats) {
+    typedef HashMap<int, int, StatsIntPolicy> Map;
+    Map map;
+    ASSERT_TRUE(map.init());
+
+    for (int i = 0; i < 1000; i++) {
+        Map::Insert p = map.findForAdd(i);
+        ASSERT_TRUE(map.add(p, i, i));
+    }
+
+    // Growing from 16 to 2048 slots takes seven rehashes.
+    HashTableStats stats = map.stats();
+    EXPECT_EQ(stats.capacity, (size_t)2048);
+    EXPECT_EQ(stats.elements, (size_t)1000);
+    EXPECT_EQ(stats.rehashes, (uint64_t)7);
+    EXPECT_GT(stats.bytesMoved, (uint64_t)0);
+    EXPECT_EQ(stats.tombstones, (size_t)0);
+    EXPECT_EQ(SumProbes(map), (size_t)1000);
+    EXPECT_GE(stats.averageProbeLength, 1.0);
+    EXPECT_LT(stats.averageProbeLength, 2.0);
+    EXPECT_GE(stats.maxCluster, stats.maxProbeLength);
+
+    for (int i = 0; i < 1000; i += 2)
+        map.removeIfExists(i);
+    stats = map.stats();
+    EXPECT_EQ(stats.tombstones, (size_t)500);
+    EXPECT_DOUBLE_EQ(stats.tombstoneRatio(), 500.0 / 2048.0);
+    EXPECT_EQ(SumProbes(map), (size_t)500);
+
+    // Without HashStats::Enabled, resizes are not counted.
+    HashMap<int, int, IntPolicy> plain;
+    ASSERT_TRUE(plain.init());
+    for (int i = 0; i < 1000; i++) {
+        HashMap<int, int, IntPolicy>::Insert p = plain.findForAdd(i);
+        ASSERT_TRUE(plain.add(p, i, i));
+    }
+    EXPECT_EQ(plain.stats().rehashes, (uint64_t)0);
+    EXPECT_EQ(plain.stats().bytesMoved, (uint64_t)0);
+    EXPECT_EQ(SumProbes(plain), (size_t)1000);
+}
+
+TEST(HashMap, StatsWeakHash) {
+    // With only seven distinct hashes, probe sequences get long.
+    typedef HashMap<int, int, BackwardShiftCollidingPolicy> Map;
+    Map map;
+    ASSERT_TRUE(map.init());
+    for (int i = 0; i < 200; i++) {
+        Map::Insert p = map.findForAdd(i);
+        ASSERT_TRUE(map.add(p, i, i));
+    }
+
+    HashTableStats stats = map.stats();
+    EXPECT_EQ(SumProbes(map), (size_t)200);
+    EXPECT_GE(stats.maxProbeLength, (size_t)200 / 7);
+    EXPECT_GE(stats.maxCluster, (size_t)200 / 7);
+    EXPECT_GT(stats.averageProbeLength, 4.0);
+    EXPECT_GT(stats.probes[HashTableStats::kProbeBuckets - 1], (size_t)0);
+
+    // With control bytes, a probe covers a group of sixteen slots.
+    typedef HashMap<int, int, CollidingIntPolicy> ControlMap;
+    ControlMap control;
+    ASSERT_TRUE(control.init());
+    for (int i = 0; i < 500; i++) {
+        ControlMap::Insert p = control.findForAdd(i);
+        ASSERT_TRUE(control.add(p, i, i));
+    }
+    stats = control.stats();
+    EXPECT_EQ(SumProbes(control), (size_t)500);
+    EXPECT_GE(stats.maxProbeLength, (size_t)500 / 7 / 16);
+    EXPECT_LT(stats.maxProbeLength, (size_t)500 / 7);
+}
+
+struct ParallelIntPolicy : public IntPolicy {
+    static const uint32_t kRehashThreads = 4;
+    typedef RehashThreads RehashWorkers;
+};
+
+// Long clusters, an odd thread count, and split storage, so that entries
+// are deferred across region boundaries.
+struct ParallelCollidingPolicy {
+    static const HashStorage kStorage = HashStorage::Split;
+    static const HashDeletion kDeletion = HashDeletion::BackwardShift;
+    static const uint32_t kRehashThreads = 3;
+    typedef RehashThreads RehashWorkers;
+
+    static inline uint32_t hash(int key) {
+        return key % 1000;
+    }
+    static inline bool matches(int find, int key) {
+        return find == key;
+    }
+};
+
+template <typename Map>
+static void
+TestParallelRehash(int count)
+{
+    Map map;
+    ASSERT_TRUE(map.init());
+
+    // The last resize moves more than 65536 entries, so it is parallel.
+    for (int i = 0; i < count; i++) {
+        typename Map::Insert p = map.findForAdd(i);
+        ASSERT_FALSE(p.found());
+        ASSERT_TRUE(map.add(p, i, i * 3));
+    }
+    EXPECT_EQ(map.elements(), size_t(count));
+
+    for (int i = 0; i < count; i++) {
+        typename Map::Result r = map.find(i);
+        ASSERT_TRUE(r.found());
+        ASSERT_EQ(r->value, i * 3);
+    }
+    EXPECT_FALSE(map.find(count).found());
+
+    size_t seen = 0;
+    for (typename Map::iterator iter = map.iter(); !iter.empty(); iter.next())
+        seen++;
+    EXPECT_EQ(seen, size_t(count));
+
+    for (int i = 0; i < count; i += 2)
+        map.removeIfExists(i);
+    for (int i = 0; i < count; i++)
+        ASSERT_EQ(map.find(i).found(), i % 2 == 1);
+}
+
+// Runs every worker on the calling thread, as RehashThreads does for
+// threads it cannot start.
+struct CountingRehashWorkers {
+    static size_t sWorkers;
+
+    template <typename Fn>
+    static void run(uint32_t count, Fn& fn) {
+        for (uint32_t i = count; i > 0; i--) {
+            fn(i - 1);
+            sWorkers++;
+        }
+    }
+};
+
+size_t CountingRehashWorkers::sWorkers = 0;
+
+struct InlineParallelPolicy : public IntPolicy {
+    static const uint32_t kRehashThreads = 4;
+    typedef CountingRehashWorkers RehashWorkers;
+};
+
+TEST(HashMap, ParallelRehash) {
+    TestParallelRehash<HashMap<int, int, ParallelIntPolicy>>(200000);
+    TestParallelRehash<HashMap<int, int, ParallelCollidingPolicy>>(100000);
+
+    CountingRehashWorkers::sWorkers = 0;
+    TestParallelRehash<HashMap<int, int, InlineParallelPolicy>>(200000);
+    EXPECT_GT(CountingRehashWorkers::sWorkers, (size_t)0);
+    EXPECT_EQ(CountingRehashWorkers::sWorkers % 4, (size_t)0);
+}
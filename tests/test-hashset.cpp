@@ -0,0 +1,125 @@
+// vim: set sts=8 ts=2 sw=2 tw=99 et:
+//
+// Copyright (C) 2013, David Anderson and AlliedModders LLC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of AlliedModders LLC nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+#include <amtl/am-hashset.h>
+#include <amtl/am-string.h>
+#include <gtest/gtest.h>
+#include "runner.h"
+
+using namespace ke;
+
+struct StringSetPolicy {
+    static inline uint32_t hash(const char* key) {
+        return FastHashCharSequence(key, strlen(key));
+    }
+    static inline uint32_t hash(const std::string& key) {
+        return FastHashCharSequence(key.c_str(), key.size());
+    }
+    static inline bool matches(const char* find, const std::string& key) {
+        return key.compare(find) == 0;
+    }
+    static inline bool matches(const std::string& find, const std::string& key) {
+        return key == find;
+    }
+};
+
+TEST(HashSet, Basic) {
+    HashSet<std::string, StringSetPolicy> set;
+    ASSERT_TRUE(set.init());
+
+    EXPECT_FALSE(set.has("cat"));
+    set.add("cat");
+    EXPECT_TRUE(set.has("cat"));
+    set.add("cat");
+    EXPECT_EQ(set.elements(), (size_t)1);
+
+    set.removeIfExists("cat");
+    EXPECT_FALSE(set.has("cat"));
+    EXPECT_EQ(set.elements(), (size_t)0);
+}
+
+TEST(HashSet, AddAll) {
+    HashSet<std::string, StringSetPolicy> set;
+
+    std::vector<std::string> keys;
+    for (int i = 0; i < 500; i++)
+        keys.push_back("key" + std::to_string(i));
+    keys.push_back("key7");
+
+    ASSERT_TRUE(set.reserve(keys.size()));
+    size_t memory = set.estimateMemoryUse();
+
+    ASSERT_TRUE(set.addAll(keys));
+    EXPECT_EQ(set.elements(), (size_t)500);
+    EXPECT_EQ(set.estimateMemoryUse(), memory);
+    for (const auto& key : keys)
+        EXPECT_TRUE(set.has(key));
+
+    const char* more[] = {"a", "b", "key3"};
+    ASSERT_TRUE(set.addAll(more));
+    EXPECT_EQ(set.elements(), (size_t)502);
+    EXPECT_TRUE(set.has("a"));
+}
+
+TEST(HashSet, AddAllInputIterator) {
+    // A single-pass iterator must only be read once.
+    std::string words;
+    for (int i = 0; i < 100; i++)
+        words += "word" + std::to_string(i % 60) + " ";
+    std::istringstream in(words);
+
+    HashSet<std::string, StringSetPolicy> set;
+    ASSERT_TRUE(set.init());
+    ASSERT_TRUE(set.addAll(std::istream_iterator<std::string>(in),
+                           std::istream_iterator<std::string>()));
+    EXPECT_EQ(set.elements(), (size_t)60);
+    for (int i = 0; i < 60; i++)
+        EXPECT_TRUE(set.has("word" + std::to_string(i)));
+}
+
+TEST(HashSet, FindMany) {
+    typedef HashSet<std::string, StringSetPolicy> Set;
+    Set set;
+    ASSERT_TRUE(set.init());
+    set.add("a");
+    set.add("c");
+
+    const char* keys[] = {"a", "b", "c"};
+    std::vector<Set::Result> results;
+    set.findMany(keys, std::back_inserter(results));
+    ASSERT_EQ(results.size(), (size_t)3);
+    EXPECT_TRUE(results[0].found());
+    EXPECT_FALSE(results[1].found());
+    EXPECT_TRUE(results[2].found());
+    EXPECT_EQ(*results[2], "c");
+}
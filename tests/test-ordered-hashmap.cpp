@@ -0,0 +1,283 @@
+// vim: set sts=8 ts=2 sw=2 tw=99 et:
+//
+// Copyright (C) 2013, David Anderson and AlliedModders LLC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of AlliedModders LLC nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <string>
+#include <vector>
+
+#include <amtl/am-ordered-hashmap.h>
+#include <amtl/am-string.h>
+#include <gtest/gtest.h>
+#include "runner.h"
+
+using namespace ke;
+
+namespace {
+
+struct StringPolicy {
+    static inline uint32_t hash(const char* key) {
+        return FastHashCharSequence(key, strlen(key));
+    }
+    static inline uint32_t hash(const std::string& key) {
+        return FastHashCharSequence(key.c_str(), key.size());
+    }
+    static inline bool matches(const char* find, const std::string& key) {
+        return key.compare(find) == 0;
+    }
+    static inline bool matches(const std::string& find, const std::string& key) {
+        return key == find;
+    }
+};
+
+typedef OrderedHashMap<std::string, int, StringPolicy> Map;
+
+std::string
+KeyFor(int i)
+{
+    return "key" + std::to_string(i);
+}
+
+void
+AddKey(Map& map, int i)
+{
+    std::string key = KeyFor(i);
+    Map::Insert p = map.findForAdd(key);
+    ASSERT_FALSE(p.found());
+    ASSERT_TRUE(map.add(p, key, i));
+    EXPECT_EQ(p->key, key);
+}
+
+std::vector<int>
+Values(Map& map)
+{
+    std::vector<int> values;
+    for (Map::iterator iter = map.iter(); !iter.empty(); iter.next())
+        values.push_back(iter->value);
+    return values;
+}
+
+// Keys can only be looked up by C string, and hashing is counted.
+struct CStringPolicy {
+    static size_t sHashes;
+
+    static inline uint32_t hash(const char* key) {
+        sHashes++;
+        return FastHashCharSequence(key, strlen(key));
+    }
+    static inline bool matches(const char* find, const std::string& key) {
+        return key.compare(find) == 0;
+    }
+};
+
+size_t CStringPolicy::sHashes = 0;
+
+} // anonymous namespace
+
+TEST(OrderedHashMap, InsertionOrder) {
+    Map map;
+    ASSERT_TRUE(map.init());
+
+    // Add keys in an order unrelated to their hashes.
+    std::vector<int> expected;
+    for (int i = 0; i < 500; i++) {
+        int n = (i * 7919) % 500;
+        AddKey(map, n);
+        expected.push_back(n);
+    }
+    EXPECT_EQ(map.elements(), (size_t)500);
+    EXPECT_EQ(Values(map), expected);
+
+    for (int i = 0; i < 500; i++) {
+        Map::Result r = map.find(KeyFor(i).c_str());
+        ASSERT_TRUE(r.found());
+        EXPECT_EQ(r->value, i);
+    }
+    EXPECT_FALSE(map.find("key500").found());
+
+    // Updating a value does not move its entry.
+    Map::Insert p = map.findForAdd(KeyFor(expected[0]));
+    ASSERT_TRUE(p.found());
+    p->value = -1;
+    EXPECT_EQ(map.iter()->value, -1);
+}
+
+TEST(OrderedHashMap, Remove) {
+    Map map;
+    ASSERT_TRUE(map.init());
+
+    for (int i = 0; i < 100; i++)
+        AddKey(map, i);
+
+    // Remove every third entry, then re-add one of them: it goes to the end.
+    std::vector<int> expected;
+    for (int i = 0; i < 100; i++) {
+        if (i % 3 == 0)
+            map.removeIfExists(KeyFor(i));
+        else
+            expected.push_back(i);
+    }
+    AddKey(map, 3);
+    expected.push_back(3);
+
+    EXPECT_EQ(map.elements(), expected.size());
+    EXPECT_EQ(Values(map), expected);
+    EXPECT_FALSE(map.find(KeyFor(6)).found());
+
+    // Compacting closes the holes without changing the order.
+    map.compact();
+    EXPECT_EQ(Values(map), expected);
+    for (int i : expected) {
+        Map::Result r = map.find(KeyFor(i));
+        ASSERT_TRUE(r.found());
+        EXPECT_EQ(r->value, i);
+    }
+
+    // Erase during iteration.
+    for (Map::iterator iter = map.iter(); !iter.empty(); iter.next()) {
+        if (iter->value % 2 == 0)
+            iter.erase();
+    }
+    std::vector<int> odd;
+    for (int i : expected) {
+        if (i % 2 != 0)
+            odd.push_back(i);
+    }
+    EXPECT_EQ(Values(map), odd);
+    EXPECT_EQ(map.elements(), odd.size());
+
+    map.clear();
+    EXPECT_EQ(map.elements(), (size_t)0);
+    EXPECT_TRUE(map.iter().empty());
+    AddKey(map, 1);
+    EXPECT_EQ(Values(map), std::vector<int>{1});
+}
+
+TEST(OrderedHashMap, CompactWithoutRehash) {
+    OrderedHashMap<std::string, int, CStringPolicy> map;
+    ASSERT_TRUE(map.init());
+
+    std::vector<std::string> keys;
+    for (int i = 0; i < 200; i++)
+        keys.push_back(KeyFor(i));
+    for (int i = 0; i < 200; i++) {
+        auto p = map.findForAdd(keys[i].c_str());
+        ASSERT_TRUE(map.add(p, keys[i], i));
+    }
+
+    // Moving entries during compaction or erase must not hash their keys.
+    for (int i = 0; i < 200; i += 2)
+        map.removeIfExists(keys[i].c_str());
+    CStringPolicy::sHashes = 0;
+    map.compact();
+    for (auto iter = map.iter(); !iter.empty(); iter.next()) {
+        if (iter->value % 3 == 0)
+            iter.erase();
+    }
+    EXPECT_EQ(CStringPolicy::sHashes, (size_t)0);
+
+    for (int i = 0; i < 200; i++) {
+        auto r = map.find(keys[i].c_str());
+        EXPECT_EQ(r.found(), i % 2 != 0 && i % 3 != 0);
+        if (r.found()) {
+            EXPECT_EQ(r->value, i);
+        }
+    }
+}
+
+TEST(OrderedHashMap, MassRemoval) {
+    // After most entries are removed, iteration must not keep walking their
+    // holes.
+    Map map;
+    ASSERT_TRUE(map.init());
+    for (int i = 0; i < 10000; i++)
+        AddKey(map, i);
+
+    for (int i = 0; i < 9999; i++) {
+        map.removeIfExists(KeyFor(i));
+        ASSERT_LE(map.slotsUsed(), 2 * map.elements());
+    }
+    EXPECT_EQ(map.slotsUsed(), (size_t)1);
+    EXPECT_EQ(Values(map), std::vector<int>{9999});
+
+    // The same holds after erasing during iteration, once it finishes.
+    for (int i = 0; i < 9999; i++)
+        AddKey(map, i);
+    for (Map::iterator iter = map.iter(); !iter.empty(); iter.next()) {
+        if (iter->value % 100 != 0)
+            iter.erase();
+    }
+    EXPECT_EQ(map.elements(), (size_t)100);
+    EXPECT_LE(map.slotsUsed(), 2 * map.elements());
+
+    std::vector<int> expected;
+    for (int i = 0; i < 9999; i += 100)
+        expected.push_back(i);
+    EXPECT_EQ(Values(map), expected);
+    for (int i : expected)
+        EXPECT_EQ(map.find(KeyFor(i))->value, i);
+}
+
+TEST(OrderedHashMap, Churn) {
+    // Repeatedly add and remove, so the item array fills up with holes and
+    // must be compacted rather than grown.
+    Map map;
+    ASSERT_TRUE(map.init());
+
+    std::vector<int> expected;
+    for (int i = 0; i < 5000; i++) {
+        AddKey(map, i);
+        expected.push_back(i);
+        if (expected.size() > 20) {
+            map.removeIfExists(KeyFor(expected[0]));
+            expected.erase(expected.begin());
+        }
+    }
+    EXPECT_EQ(Values(map), expected);
+    EXPECT_LT(map.estimateMemoryUse(), (size_t)4096);
+
+    for (int i = 0; i < 5000; i++) {
+        Map::Result r = map.find(KeyFor(i));
+        EXPECT_EQ(r.found(), i >= expected[0]);
+    }
+}
+
+TEST(OrderedHashMap, Reserve) {
+    Map map;
+    ASSERT_TRUE(map.init());
+    ASSERT_TRUE(map.reserve(1000));
+
+    size_t bytes = map.estimateMemoryUse();
+    for (int i = 0; i < 1000; i++)
+        AddKey(map, i);
+    EXPECT_EQ(map.estimateMemoryUse(), bytes);
+
+    Map moved(std::move(map));
+    EXPECT_EQ(moved.elements(), (size_t)1000);
+    EXPECT_EQ(map.elements(), (size_t)0);
+    EXPECT_TRUE(moved.find("key999").found());
+}
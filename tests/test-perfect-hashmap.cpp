@@ -0,0 +1,131 @@
+// vim: set sts=8 ts=2 sw=2 tw=99 et:
+//
+// Copyright (C) 2013, David Anderson and AlliedModders LLC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of AlliedModders LLC nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <string>
+
+#include <amtl/am-perfect-hashmap.h>
+#include <gtest/gtest.h>
+#include "runner.h"
+
+using namespace ke;
+
+namespace {
+
+enum class Token {
+    If,
+    Else,
+    While,
+    For,
+    Return,
+    Break,
+    Continue,
+    Switch,
+    Case,
+    Default,
+};
+
+static constexpr auto kKeywords = MakePerfectHashMap<const char*, Token>({
+    {"if", Token::If},
+    {"else", Token::Else},
+    {"while", Token::While},
+    {"for", Token::For},
+    {"return", Token::Return},
+    {"break", Token::Break},
+    {"continue", Token::Continue},
+    {"switch", Token::Switch},
+    {"case", Token::Case},
+    {"default", Token::Default},
+});
+
+// Lookups work in constant expressions too.
+static_assert(kKeywords.find("while")->value == Token::While, "constexpr lookup");
+static_assert(!kKeywords.contains("whilst"), "constexpr miss");
+static_assert(kKeywords.elements() == 10, "constexpr size");
+
+static constexpr auto kOpcodes = MakePerfectHashMap<int, const char*>({
+    {0x01, "nop"},
+    {0x10, "push"},
+    {0x11, "pop"},
+    {0x20, "add"},
+    {0x21, "sub"},
+    {-1, "invalid"},
+});
+
+static_assert(kOpcodes.find(0x21) != nullptr, "integer keys");
+
+} // anonymous namespace
+
+TEST(PerfectHashMap, Strings) {
+    const char* names[] = {"if", "else", "while", "for", "return",
+                           "break", "continue", "switch", "case", "default"};
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        std::string name = names[i];
+        const auto* entry = kKeywords.find(name);
+        ASSERT_NE(entry, nullptr);
+        EXPECT_EQ(entry->value, Token(i));
+        EXPECT_EQ(kKeywords.find(name.c_str()), entry);
+    }
+
+    EXPECT_FALSE(kKeywords.contains("iff"));
+    EXPECT_FALSE(kKeywords.contains(""));
+    EXPECT_FALSE(kKeywords.contains(std::string("Return")));
+
+    size_t count = 0;
+    for (const auto& entry : kKeywords) {
+        EXPECT_EQ(entry.value, Token(count));
+        count++;
+    }
+    EXPECT_EQ(count, (size_t)10);
+}
+
+TEST(PerfectHashMap, Integers) {
+    EXPECT_STREQ(kOpcodes.find(0x10)->value, "push");
+    EXPECT_STREQ(kOpcodes.find(-1)->value, "invalid");
+    for (int i = -10; i < 100; i++) {
+        bool expected = i == 0x01 || i == 0x10 || i == 0x11 || i == 0x20 || i == 0x21 || i == -1;
+        EXPECT_EQ(kOpcodes.contains(i), expected);
+    }
+}
+
+TEST(PerfectHashMap, Large) {
+    // Enough keys that the table is full and needs many seeds. Built at
+    // runtime, from the same code.
+    static const size_t kCount = 512;
+    static PerfectHashEntry<int, int> entries[kCount];
+    for (size_t i = 0; i < kCount; i++)
+        entries[i] = PerfectHashEntry<int, int>{int(i * 7919), int(i)};
+
+    PerfectHashMap<int, int, kCount> map(entries);
+    for (size_t i = 0; i < kCount; i++) {
+        const auto* entry = map.find(int(i * 7919));
+        ASSERT_NE(entry, nullptr);
+        EXPECT_EQ(entry->value, int(i));
+    }
+    EXPECT_FALSE(map.contains(1));
+}
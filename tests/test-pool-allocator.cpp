@@ -0,0 +1,195 @@
+// vim: set sts=8 ts=2 sw=2 tw=99 et:
+//
+// Copyright (C) 2013, David Anderson and AlliedModders LLC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of AlliedModders LLC nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <amtl/am-fixedarray.h>
+#include <amtl/am-hashmap.h>
+#include <amtl/am-pool-allocator.h>
+#include <gtest/gtest.h>
+#include "runner.h"
+
+using namespace ke;
+
+namespace {
+
+struct IntPolicy {
+    static inline uint32_t hash(int key) {
+        return HashInt32(key);
+    }
+    static inline bool matches(int find, int key) {
+        return find == key;
+    }
+};
+
+} // anonymous namespace
+
+TEST(Pool, SizeClasses) {
+    uint32_t last = 0;
+    for (size_t bytes = 1; bytes <= detail::kPoolMaxSmallSize; bytes++) {
+        uint32_t sizeClass = detail::PoolSizeClass(bytes);
+        ASSERT_LT(sizeClass, detail::kPoolSizeClasses);
+        ASSERT_GE(detail::PoolClassSize(sizeClass), bytes);
+        if (sizeClass > 0) {
+            ASSERT_LT(detail::PoolClassSize(sizeClass - 1), bytes);
+        }
+        ASSERT_LE(detail::PoolClassSize(sizeClass) - bytes, bytes / 4 + 16);
+        ASSERT_GE(sizeClass, last);
+        last = sizeClass;
+    }
+    EXPECT_EQ(last, detail::kPoolSizeClasses - 1);
+    EXPECT_EQ(detail::PoolClassSize(last), detail::kPoolMaxSmallSize);
+}
+
+TEST(Pool, Allocate) {
+    Pool<> pool;
+
+    std::vector<char*> blocks;
+    for (size_t bytes = 0; bytes <= 5000; bytes += 7) {
+        char* p = (char*)pool.allocate(bytes);
+        ASSERT_NE(p, nullptr);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % 8, (uintptr_t)0);
+        memset(p, int(bytes & 0xff), bytes);
+        blocks.push_back(p);
+    }
+    for (size_t i = 0; i < blocks.size(); i++) {
+        size_t bytes = i * 7;
+        for (size_t j = 0; j < bytes; j++)
+            ASSERT_EQ((unsigned char)blocks[i][j], bytes & 0xff);
+        pool.deallocate(blocks[i], bytes);
+    }
+
+    // Freed blocks are reused before new memory is taken.
+    size_t used = pool.memoryUse();
+    for (int i = 0; i < 10000; i++)
+        pool.deallocate(pool.allocate(100), 100);
+    EXPECT_EQ(pool.memoryUse(), used);
+
+    void* first = pool.allocate(40);
+    pool.deallocate(first, 40);
+    EXPECT_EQ(pool.allocate(40), first);
+    pool.deallocate(first, 40);
+
+    // Blocks have no header, so a fresh pool hands out a size class's blocks
+    // back to back.
+    {
+        Pool<> fresh;
+        char* a = (char*)fresh.allocate(48);
+        char* b = (char*)fresh.allocate(48);
+        EXPECT_EQ(a > b ? a - b : b - a, 48);
+        fresh.deallocate(a, 48);
+        fresh.deallocate(b, 48);
+    }
+
+    // Large allocations go straight to the system.
+    void* big = pool.allocate(1000000);
+    ASSERT_NE(big, nullptr);
+    memset(big, 0xcc, 1000000);
+    EXPECT_EQ(pool.memoryUse(), used + 1000000);
+    pool.deallocate(big, 1000000);
+    EXPECT_EQ(pool.memoryUse(), used);
+
+    pool.deallocate(nullptr, 0);
+    pool.flushThreadCache();
+    EXPECT_LT(pool.memoryUse(), used);
+}
+
+TEST(Pool, Containers) {
+    Pool<> pool;
+    PoolAllocatorPolicy ap(&pool);
+
+    HashMap<int, int, IntPolicy, PoolAllocatorPolicy> map(ap);
+    ASSERT_TRUE(map.init());
+    for (int i = 0; i < 10000; i++) {
+        auto p = map.findForAdd(i);
+        ASSERT_TRUE(map.add(p, i, -i));
+    }
+    for (int i = 0; i < 10000; i += 2)
+        map.removeIfExists(i);
+    for (int i = 0; i < 10000; i++)
+        EXPECT_EQ(map.find(i).found(), (i % 2) == 1);
+
+    FixedArray<int, PoolAllocatorPolicy> array(1000, ap);
+    ASSERT_TRUE(array.initialize());
+    for (size_t i = 0; i < array.size(); i++)
+        array[i] = int(i);
+    FixedArray<int, PoolAllocatorPolicy> copy(array);
+    EXPECT_TRUE(copy == array);
+}
+
+TEST(Pool, Threads) {
+    static const size_t kThreads = 4;
+    static const size_t kRounds = 20000;
+
+    Pool<> pool;
+
+    // Each thread frees half of what it allocates, and hands the other half
+    // to the next thread to free.
+    std::vector<std::vector<std::pair<char*, size_t>>> handoff(kThreads);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < kThreads; t++) {
+        threads.emplace_back([&, t]() -> void {
+            uint32_t seed = uint32_t(t) * 7919 + 1;
+            std::vector<std::pair<char*, size_t>> live;
+            for (size_t i = 0; i < kRounds; i++) {
+                seed = seed * 1103515245 + 12345;
+                size_t bytes = 1 + (seed >> 16) % 600;
+                char* p = (char*)pool.allocate(bytes);
+                p[0] = char(t);
+                p[bytes - 1] = char(t);
+                live.emplace_back(p, bytes);
+                if (live.size() > 64) {
+                    pool.deallocate(live.front().first, live.front().second);
+                    live.erase(live.begin());
+                }
+            }
+            handoff[t] = std::move(live);
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+    threads.clear();
+
+    for (size_t t = 0; t < kThreads; t++) {
+        threads.emplace_back([&, t]() -> void {
+            for (const auto& block : handoff[(t + 1) % kThreads]) {
+                EXPECT_EQ(block.first[0], char((t + 1) % kThreads));
+                pool.deallocate(block.first, block.second);
+            }
+            pool.flushThreadCache();
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+}
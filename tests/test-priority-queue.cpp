@@ -27,6 +27,7 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+#include <amtl/am-pool-allocator.h>
 #include <amtl/am-priority-queue.h>
 #include <assert.h>
 #include <gtest/gtest.h>
@@ -51,3 +52,16 @@ TEST(PriorityQueue, Basic) {
     EXPECT_EQ(pq.pop(), 77);
     EXPECT_TRUE(pq.empty());
 }
+
+TEST(PriorityQueue, StdAllocator) {
+    Pool<> pool;
+    typedef StdAllocator<int, PoolAllocatorPolicy> Alloc;
+    Alloc alloc{PoolAllocatorPolicy(&pool)};
+    PriorityQueue<int, std::less<int>, Alloc> pq(std::less<int>(), alloc);
+    for (int i = 0; i < 100; i++)
+        pq.add((i * 37) % 100);
+    EXPECT_GT(pool.memoryUse(), (size_t)0);
+    for (int i = 0; i < 100; i++)
+        EXPECT_EQ(pq.pop(), i);
+    EXPECT_TRUE(pq.empty());
+}
@@ -0,0 +1,156 @@
+// vim: set sts=8 ts=2 sw=2 tw=99 et:
+//
+// Copyright (C) 2013, David Anderson and AlliedModders LLC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of AlliedModders LLC nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <string>
+
+#include <amtl/am-small-hashmap.h>
+#include <amtl/am-string.h>
+#include <gtest/gtest.h>
+#include "runner.h"
+
+using namespace ke;
+
+namespace {
+
+struct StringPolicy {
+    static inline uint32_t hash(const char* key) {
+        return FastHashCharSequence(key, strlen(key));
+    }
+    static inline uint32_t hash(const std::string& key) {
+        return FastHashCharSequence(key.c_str(), key.size());
+    }
+    static inline bool matches(const char* find, const std::string& key) {
+        return key.compare(find) == 0;
+    }
+    static inline bool matches(const std::string& find, const std::string& key) {
+        return key == find;
+    }
+};
+
+typedef SmallHashMap<std::string, std::string, StringPolicy, 4> Map;
+
+void
+AddKey(Map& map, int i)
+{
+    std::string key = "key" + std::to_string(i);
+    Map::Insert p = map.findForAdd(key);
+    ASSERT_FALSE(p.found());
+    ASSERT_TRUE(map.add(p, key, "value" + std::to_string(i)));
+    EXPECT_EQ(p->key, key);
+}
+
+} // anonymous namespace
+
+TEST(SmallHashMap, Inline) {
+    Map map;
+    for (int i = 0; i < 4; i++)
+        AddKey(map, i);
+
+    EXPECT_FALSE(map.spilled());
+    EXPECT_EQ(map.estimateMemoryUse(), (size_t)0);
+    EXPECT_EQ(map.elements(), (size_t)4);
+
+    Map::Result r = map.find("key2");
+    ASSERT_TRUE(r.found());
+    EXPECT_EQ(r->value, "value2");
+    EXPECT_FALSE(map.find("key4").found());
+
+    Map::Insert p = map.findForAdd("key1");
+    ASSERT_TRUE(p.found());
+    p->value = "changed";
+    EXPECT_EQ(map.find("key1")->value, "changed");
+
+    map.removeIfExists("key0");
+    EXPECT_FALSE(map.find("key0").found());
+    EXPECT_EQ(map.elements(), (size_t)3);
+    for (int i = 1; i < 4; i++)
+        EXPECT_TRUE(map.find("key" + std::to_string(i)).found());
+
+    map.clear();
+    EXPECT_EQ(map.elements(), (size_t)0);
+    EXPECT_FALSE(map.spilled());
+}
+
+TEST(SmallHashMap, Spill) {
+    Map map;
+    for (int i = 0; i < 100; i++) {
+        AddKey(map, i);
+        EXPECT_EQ(map.spilled(), i >= 4);
+    }
+    EXPECT_GT(map.estimateMemoryUse(), (size_t)0);
+    EXPECT_EQ(map.elements(), (size_t)100);
+
+    for (int i = 0; i < 100; i += 2)
+        map.removeIfExists("key" + std::to_string(i));
+    for (int i = 0; i < 100; i++) {
+        Map::Result r = map.find("key" + std::to_string(i));
+        ASSERT_EQ(r.found(), i % 2 == 1);
+        if (r.found()) {
+            EXPECT_EQ(r->value, "value" + std::to_string(i));
+        }
+    }
+
+    // Moving keeps the heap table.
+    Map moved(std::move(map));
+    EXPECT_TRUE(moved.spilled());
+    EXPECT_EQ(moved.elements(), (size_t)50);
+    EXPECT_EQ(map.elements(), (size_t)0);
+}
+
+TEST(SmallHashMap, Iterate) {
+    for (int count : {3, 10}) {
+        Map map;
+        for (int i = 0; i < count; i++)
+            AddKey(map, i);
+
+        // Erase every other entry while iterating, making sure the entry
+        // moved into an erased slot is still visited.
+        int visited = 0;
+        for (Map::iterator iter = map.iter(); !iter.empty(); iter.next()) {
+            visited++;
+            if (iter->value.back() % 2 == 0)
+                iter.erase();
+        }
+        EXPECT_EQ(visited, count);
+        for (int i = 0; i < count; i++)
+            EXPECT_EQ(map.find("key" + std::to_string(i)).found(), i % 2 == 1);
+    }
+}
+
+TEST(SmallHashMap, MoveInline) {
+    Map map;
+    AddKey(map, 1);
+    AddKey(map, 2);
+
+    Map moved(std::move(map));
+    EXPECT_FALSE(moved.spilled());
+    EXPECT_EQ(moved.elements(), (size_t)2);
+    EXPECT_EQ(moved.find("key2")->value, "value2");
+    EXPECT_EQ(map.elements(), (size_t)0);
+}
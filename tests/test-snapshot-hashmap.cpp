@@ -0,0 +1,172 @@
+// vim: set sts=8 ts=2 sw=2 tw=99 et:
+//
+// Copyright (C) 2013, David Anderson and AlliedModders LLC
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//  * Redistributions of source code must retain the above copyright notice, this
+//    list of conditions and the following disclaimer.
+//  * Redistributions in binary form must reproduce the above copyright notice,
+//    this list of conditions and the following disclaimer in the documentation
+//    and/or other materials provided with the distribution.
+//  * Neither the name of AlliedModders LLC nor the names of its contributors
+//    may be used to endorse or promote products derived from this software
+//    without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <amtl/am-snapshot-hashmap.h>
+#include <amtl/am-string.h>
+#include <gtest/gtest.h>
+#include "runner.h"
+
+using namespace ke;
+
+namespace {
+
+struct IntPolicy {
+    static inline uint32_t hash(int key) {
+        return HashInt32(key);
+    }
+    static inline bool matches(int find, int key) {
+        return find == key;
+    }
+};
+
+struct StringPolicy {
+    static inline uint32_t hash(const char* key) {
+        return FastHashCharSequence(key, strlen(key));
+    }
+    static inline uint32_t hash(const std::string& key) {
+        return FastHashCharSequence(key.c_str(), key.size());
+    }
+    static inline bool matches(const char* find, const std::string& key) {
+        return key.compare(find) == 0;
+    }
+    static inline bool matches(const std::string& find, const std::string& key) {
+        return key == find;
+    }
+};
+
+} // anonymous namespace
+
+TEST(SnapshotHashMap, Basic) {
+    SnapshotHashMap<std::string, int, StringPolicy> map;
+    ASSERT_TRUE(map.init());
+
+    auto empty = map.snapshot();
+    EXPECT_EQ(empty->elements(), (size_t)0);
+
+    ASSERT_TRUE(map.set("cat", 1));
+    ASSERT_TRUE(map.set("dog", 2));
+    ASSERT_TRUE(map.set("cat", 3));
+
+    int value = 0;
+    EXPECT_TRUE(map.get("cat", &value));
+    EXPECT_EQ(value, 3);
+    EXPECT_TRUE(map.contains("dog"));
+    EXPECT_EQ(map.elements(), (size_t)2);
+
+    // Old snapshots are unchanged.
+    EXPECT_EQ(empty->elements(), (size_t)0);
+    EXPECT_FALSE(empty->contains("cat"));
+
+    auto before = map.snapshot();
+    EXPECT_TRUE(map.remove("cat"));
+    EXPECT_FALSE(map.remove("cat"));
+    EXPECT_FALSE(map.contains("cat"));
+    EXPECT_TRUE(before->contains("cat"));
+
+    map.clear();
+    EXPECT_EQ(map.elements(), (size_t)0);
+    EXPECT_EQ(before->elements(), (size_t)2);
+}
+
+TEST(SnapshotHashMap, Update) {
+    SnapshotHashMap<int, int, IntPolicy> map;
+    ASSERT_TRUE(map.init());
+
+    typedef SnapshotHashMap<int, int, IntPolicy>::Map Map;
+    ASSERT_TRUE(map.update([](Map& m) -> bool {
+        for (int i = 0; i < 1000; i++) {
+            auto p = m.findForAdd(i);
+            if (!m.add(p, i, i * 3))
+                return false;
+        }
+        return true;
+    }, 1000));
+    EXPECT_EQ(map.elements(), (size_t)1000);
+
+    // Abandoned updates are not published.
+    EXPECT_FALSE(map.update([](Map& m) -> bool {
+        m.clear();
+        return false;
+    }));
+    EXPECT_EQ(map.elements(), (size_t)1000);
+
+    int sum = 0;
+    map.snapshot()->forEach([&sum](const int& key, const int& value) -> void {
+        EXPECT_EQ(value, key * 3);
+        sum += key;
+    });
+    EXPECT_EQ(sum, 999 * 1000 / 2);
+}
+
+TEST(SnapshotHashMap, Threaded) {
+    static const int kReaders = 4;
+    static const int kKeys = 200;
+
+    SnapshotHashMap<int, int, IntPolicy> map;
+    ASSERT_TRUE(map.init());
+
+    std::atomic<bool> done(false);
+    std::atomic<int> errors(0);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < kReaders; t++) {
+        readers.emplace_back([&]() -> void {
+            while (!done) {
+                // Values only ever grow, and every key present in a
+                // snapshot must have its expected value.
+                auto snap = map.snapshot();
+                snap->forEach([&](const int& key, const int& value) -> void {
+                    if (value != key + 1)
+                        errors++;
+                });
+                for (int i = 0; i < kKeys; i++) {
+                    int value;
+                    if (map.get(i, &value) && value != i + 1)
+                        errors++;
+                }
+            }
+        });
+    }
+
+    for (int i = 0; i < kKeys; i++)
+        ASSERT_TRUE(map.set(i, i + 1));
+    for (int i = 0; i < kKeys; i += 2)
+        ASSERT_TRUE(map.remove(i));
+
+    done = true;
+    for (auto& thread : readers)
+        thread.join();
+
+    EXPECT_EQ(errors.load(), 0);
+    EXPECT_EQ(map.elements(), (size_t)kKeys / 2);
+}
@@ -27,6 +27,8 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+#include <amtl/am-allocator-policies.h>
+#include <amtl/am-pool-allocator.h>
 #include <amtl/am-refcounting.h>
 #include <amtl/am-vector.h>
 #include <assert.h>
@@ -315,3 +317,46 @@ TEST(Vector, EraseIf) {
     EXPECT_EQ(items[1], 3);
     EXPECT_EQ(items[2], 5);
 }
+
+TEST(Vector, StdAllocator) {
+    Pool<> pool;
+    typedef StdAllocator<int, PoolAllocatorPolicy> Alloc;
+    Alloc alloc{PoolAllocatorPolicy(&pool)};
+
+    std::vector<int, Alloc> a(alloc);
+    std::vector<int, Alloc> b(alloc);
+    for (int i = 0; i < 100; i++) {
+        a.push_back(i);
+        b.push_back(i + 100);
+    }
+    ke::MoveExtend(&a, &b);
+    EXPECT_EQ(a.size(), (size_t)200);
+    EXPECT_TRUE(b.empty());
+
+    ke::InsertAt(&a, 0, -1);
+    ke::EmplaceAt(&a, 1, -2);
+    EXPECT_EQ(a[0], -1);
+    EXPECT_EQ(a[1], -2);
+    ke::EraseIf(&a, [](int item) -> bool {
+        return item < 0 || item % 2 == 1;
+    });
+    EXPECT_EQ(a.size(), (size_t)100);
+    EXPECT_EQ(ke::PopBack(&a), 198);
+    EXPECT_GT(pool.memoryUse(), (size_t)0);
+
+    // Allocators on different pools are not interchangeable.
+    Pool<> other;
+    Alloc otherAlloc{PoolAllocatorPolicy(&other)};
+    EXPECT_TRUE(alloc == Alloc(alloc));
+    EXPECT_FALSE(alloc == otherAlloc);
+    EXPECT_TRUE(StdAllocator<int>() == StdAllocator<char>());
+
+    // An arena needs no frees at all.
+    Arena<> arena;
+    std::vector<int, StdAllocator<int, ArenaAllocatorPolicy>> c{
+        StdAllocator<int, ArenaAllocatorPolicy>(ArenaAllocatorPolicy(&arena))};
+    for (int i = 0; i < 1000; i++)
+        c.push_back(i);
+    EXPECT_EQ(c[999], 999);
+    EXPECT_GT(arena.memoryUse(), (size_t)0);
+}